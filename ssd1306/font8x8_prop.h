@@ -0,0 +1,140 @@
+/*
+ * font8x8_prop.h
+ *
+ * Proportional version of font8x8_basic_tr for U+0020 - U+007E.
+ * Empty columns left and right of every glyph are dropped, the space is 3 columns wide.
+ * Generated from font8x8_basic_tr:
+
+	for (int code = 0x20; code < 0x7F; code++) {
+		int first = 0, last = 7;
+		while (first < 8 && font8x8_basic_tr[code][first] == 0) first++;
+		while (last > first && font8x8_basic_tr[code][last] == 0) last--;
+		if (first == 8) { first = 0; last = 2; }
+		for (int w = first; w <= last; w++) printf("0x%.2X, ", font8x8_basic_tr[code][w]);
+		printf("// U+00%.2X (%c)\n", code, code);
+	}
+ */
+
+#ifndef MAIN_FONT8X8_PROP_H_
+#define MAIN_FONT8X8_PROP_H_
+
+static const uint8_t font8x8_prop_bitmap[] = {
+    0x00, 0x00, 0x00,                               // U+0020 (space)
+    0x06, 0x5F, 0x5F, 0x06,                         // U+0021 (!)
+    0x03, 0x03, 0x00, 0x03, 0x03,                   // U+0022 (")
+    0x14, 0x7F, 0x7F, 0x14, 0x7F, 0x7F, 0x14,       // U+0023 (#)
+    0x24, 0x2E, 0x6B, 0x6B, 0x3A, 0x12,             // U+0024 ($)
+    0x46, 0x66, 0x30, 0x18, 0x0C, 0x66, 0x62,       // U+0025 (%)
+    0x30, 0x7A, 0x4F, 0x5D, 0x37, 0x7A, 0x48,       // U+0026 (&)
+    0x04, 0x07, 0x03,                               // U+0027 (')
+    0x1C, 0x3E, 0x63, 0x41,                         // U+0028 (()
+    0x41, 0x63, 0x3E, 0x1C,                         // U+0029 ())
+    0x08, 0x2A, 0x3E, 0x1C, 0x1C, 0x3E, 0x2A, 0x08, // U+002A (*)
+    0x08, 0x08, 0x3E, 0x3E, 0x08, 0x08,             // U+002B (+)
+    0x80, 0xE0, 0x60,                               // U+002C (,)
+    0x08, 0x08, 0x08, 0x08, 0x08, 0x08,             // U+002D (-)
+    0x60, 0x60,                                     // U+002E (.)
+    0x60, 0x30, 0x18, 0x0C, 0x06, 0x03, 0x01,       // U+002F (/)
+    0x3E, 0x7F, 0x71, 0x59, 0x4D, 0x7F, 0x3E,       // U+0030 (0)
+    0x40, 0x42, 0x7F, 0x7F, 0x40, 0x40,             // U+0031 (1)
+    0x62, 0x73, 0x59, 0x49, 0x6F, 0x66,             // U+0032 (2)
+    0x22, 0x63, 0x49, 0x49, 0x7F, 0x36,             // U+0033 (3)
+    0x18, 0x1C, 0x16, 0x53, 0x7F, 0x7F, 0x50,       // U+0034 (4)
+    0x27, 0x67, 0x45, 0x45, 0x7D, 0x39,             // U+0035 (5)
+    0x3C, 0x7E, 0x4B, 0x49, 0x79, 0x30,             // U+0036 (6)
+    0x03, 0x03, 0x71, 0x79, 0x0F, 0x07,             // U+0037 (7)
+    0x36, 0x7F, 0x49, 0x49, 0x7F, 0x36,             // U+0038 (8)
+    0x06, 0x4F, 0x49, 0x69, 0x3F, 0x1E,             // U+0039 (9)
+    0x66, 0x66,                                     // U+003A (:)
+    0x80, 0xE6, 0x66,                               // U+003B (;)
+    0x08, 0x1C, 0x36, 0x63, 0x41,                   // U+003C (<)
+    0x24, 0x24, 0x24, 0x24, 0x24, 0x24,             // U+003D (=)
+    0x41, 0x63, 0x36, 0x1C, 0x08,                   // U+003E (>)
+    0x02, 0x03, 0x51, 0x59, 0x0F, 0x06,             // U+003F (?)
+    0x3E, 0x7F, 0x41, 0x5D, 0x5D, 0x1F, 0x1E,       // U+0040 (@)
+    0x7C, 0x7E, 0x13, 0x13, 0x7E, 0x7C,             // U+0041 (A)
+    0x41, 0x7F, 0x7F, 0x49, 0x49, 0x7F, 0x36,       // U+0042 (B)
+    0x1C, 0x3E, 0x63, 0x41, 0x41, 0x63, 0x22,       // U+0043 (C)
+    0x41, 0x7F, 0x7F, 0x41, 0x63, 0x3E, 0x1C,       // U+0044 (D)
+    0x41, 0x7F, 0x7F, 0x49, 0x5D, 0x41, 0x63,       // U+0045 (E)
+    0x41, 0x7F, 0x7F, 0x49, 0x1D, 0x01, 0x03,       // U+0046 (F)
+    0x1C, 0x3E, 0x63, 0x41, 0x51, 0x73, 0x72,       // U+0047 (G)
+    0x7F, 0x7F, 0x08, 0x08, 0x7F, 0x7F,             // U+0048 (H)
+    0x41, 0x7F, 0x7F, 0x41,                         // U+0049 (I)
+    0x30, 0x70, 0x40, 0x41, 0x7F, 0x3F, 0x01,       // U+004A (J)
+    0x41, 0x7F, 0x7F, 0x08, 0x1C, 0x77, 0x63,       // U+004B (K)
+    0x41, 0x7F, 0x7F, 0x41, 0x40, 0x60, 0x70,       // U+004C (L)
+    0x7F, 0x7F, 0x0E, 0x1C, 0x0E, 0x7F, 0x7F,       // U+004D (M)
+    0x7F, 0x7F, 0x06, 0x0C, 0x18, 0x7F, 0x7F,       // U+004E (N)
+    0x1C, 0x3E, 0x63, 0x41, 0x63, 0x3E, 0x1C,       // U+004F (O)
+    0x41, 0x7F, 0x7F, 0x49, 0x09, 0x0F, 0x06,       // U+0050 (P)
+    0x1E, 0x3F, 0x21, 0x71, 0x7F, 0x5E,             // U+0051 (Q)
+    0x41, 0x7F, 0x7F, 0x09, 0x19, 0x7F, 0x66,       // U+0052 (R)
+    0x26, 0x6F, 0x4D, 0x59, 0x73, 0x32,             // U+0053 (S)
+    0x03, 0x41, 0x7F, 0x7F, 0x41, 0x03,             // U+0054 (T)
+    0x7F, 0x7F, 0x40, 0x40, 0x7F, 0x7F,             // U+0055 (U)
+    0x1F, 0x3F, 0x60, 0x60, 0x3F, 0x1F,             // U+0056 (V)
+    0x7F, 0x7F, 0x30, 0x18, 0x30, 0x7F, 0x7F,       // U+0057 (W)
+    0x43, 0x67, 0x3C, 0x18, 0x3C, 0x67, 0x43,       // U+0058 (X)
+    0x07, 0x4F, 0x78, 0x78, 0x4F, 0x07,             // U+0059 (Y)
+    0x47, 0x63, 0x71, 0x59, 0x4D, 0x67, 0x73,       // U+005A (Z)
+    0x7F, 0x7F, 0x41, 0x41,                         // U+005B ([)
+    0x01, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60,       // U+005C (\)
+    0x41, 0x41, 0x7F, 0x7F,                         // U+005D (])
+    0x08, 0x0C, 0x06, 0x03, 0x06, 0x0C, 0x08,       // U+005E (^)
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, // U+005F (_)
+    0x03, 0x07, 0x04,                               // U+0060 (`)
+    0x20, 0x74, 0x54, 0x54, 0x3C, 0x78, 0x40,       // U+0061 (a)
+    0x41, 0x7F, 0x3F, 0x48, 0x48, 0x78, 0x30,       // U+0062 (b)
+    0x38, 0x7C, 0x44, 0x44, 0x6C, 0x28,             // U+0063 (c)
+    0x30, 0x78, 0x48, 0x49, 0x3F, 0x7F, 0x40,       // U+0064 (d)
+    0x38, 0x7C, 0x54, 0x54, 0x5C, 0x18,             // U+0065 (e)
+    0x48, 0x7E, 0x7F, 0x49, 0x03, 0x02,             // U+0066 (f)
+    0x98, 0xBC, 0xA4, 0xA4, 0xF8, 0x7C, 0x04,       // U+0067 (g)
+    0x41, 0x7F, 0x7F, 0x08, 0x04, 0x7C, 0x78,       // U+0068 (h)
+    0x44, 0x7D, 0x7D, 0x40,                         // U+0069 (i)
+    0x60, 0xE0, 0x80, 0x80, 0xFD, 0x7D,             // U+006A (j)
+    0x41, 0x7F, 0x7F, 0x10, 0x38, 0x6C, 0x44,       // U+006B (k)
+    0x41, 0x7F, 0x7F, 0x40,                         // U+006C (l)
+    0x7C, 0x7C, 0x18, 0x38, 0x1C, 0x7C, 0x78,       // U+006D (m)
+    0x7C, 0x7C, 0x04, 0x04, 0x7C, 0x78,             // U+006E (n)
+    0x38, 0x7C, 0x44, 0x44, 0x7C, 0x38,             // U+006F (o)
+    0x84, 0xFC, 0xF8, 0xA4, 0x24, 0x3C, 0x18,       // U+0070 (p)
+    0x18, 0x3C, 0x24, 0xA4, 0xF8, 0xFC, 0x84,       // U+0071 (q)
+    0x44, 0x7C, 0x78, 0x4C, 0x04, 0x1C, 0x18,       // U+0072 (r)
+    0x48, 0x5C, 0x54, 0x54, 0x74, 0x24,             // U+0073 (s)
+    0x04, 0x3E, 0x7F, 0x44, 0x24,                   // U+0074 (t)
+    0x3C, 0x7C, 0x40, 0x40, 0x3C, 0x7C, 0x40,       // U+0075 (u)
+    0x1C, 0x3C, 0x60, 0x60, 0x3C, 0x1C,             // U+0076 (v)
+    0x3C, 0x7C, 0x70, 0x38, 0x70, 0x7C, 0x3C,       // U+0077 (w)
+    0x44, 0x6C, 0x38, 0x10, 0x38, 0x6C, 0x44,       // U+0078 (x)
+    0x9C, 0xBC, 0xA0, 0xA0, 0xFC, 0x7C,             // U+0079 (y)
+    0x4C, 0x64, 0x74, 0x5C, 0x4C, 0x64,             // U+007A (z)
+    0x08, 0x08, 0x3E, 0x77, 0x41, 0x41,             // U+007B ({)
+    0x77, 0x77,                                     // U+007C (|)
+    0x41, 0x41, 0x77, 0x3E, 0x08, 0x08,             // U+007D (})
+    0x02, 0x03, 0x01, 0x03, 0x02, 0x03, 0x01,       // U+007E (~)
+};
+
+// Start of every glyph in font8x8_prop_bitmap
+static const uint16_t font8x8_prop_offsets[] = {
+       0,    3,    7,   12,   19,   25,   32,   39,   42,   46,   50,   58,
+      64,   67,   73,   75,   82,   89,   95,  101,  107,  114,  120,  126,
+     132,  138,  144,  146,  149,  154,  160,  165,  171,  178,  184,  191,
+     198,  205,  212,  219,  226,  232,  236,  243,  250,  257,  264,  271,
+     278,  285,  291,  298,  304,  310,  316,  322,  329,  336,  342,  349,
+     353,  360,  364,  371,  379,  382,  389,  396,  402,  409,  415,  421,
+     428,  435,  439,  445,  452,  456,  463,  469,  475,  482,  489,  496,
+     502,  507,  514,  520,  527,  534,  540,  546,  552,  554,  560,
+};
+
+static const uint8_t font8x8_prop_widths[] = {
+    3, 4, 5, 7, 6, 7, 7, 3, 4, 4, 8, 6, 3, 6, 2, 7,
+    7, 6, 6, 6, 7, 6, 6, 6, 6, 6, 2, 3, 5, 6, 5, 6,
+    7, 6, 7, 7, 7, 7, 7, 7, 6, 4, 7, 7, 7, 7, 7, 7,
+    7, 6, 7, 6, 6, 6, 6, 7, 7, 6, 7, 4, 7, 4, 7, 8,
+    3, 7, 7, 6, 7, 6, 6, 7, 7, 4, 6, 7, 4, 7, 6, 6,
+    7, 7, 7, 6, 5, 7, 6, 7, 7, 6, 6, 6, 2, 6, 7,
+};
+
+#endif /* MAIN_FONT8X8_PROP_H_ */
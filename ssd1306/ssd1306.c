@@ -1,32 +1,392 @@
 #include <string.h>
+#include <assert.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 
+#include "esp_heap_caps.h"
 #include "esp_log.h"
 
 #include "ssd1306.h"
-#include "font8x8_basic.h"
 
 #define TAG "SSD1306"
 
-#define PACK8 __attribute__((aligned( __alignof__( uint8_t ) ), packed ))
+#define DIRTY_CLEAN_START 0x7FFF
+#define DIRTY_CLEAN_END   -1
 
-typedef union out_column_t {
-	uint32_t u32;
-	uint8_t  u8[4];
-} PACK8 out_column_t;
+// GDDRAM rows, a ring holding canvas rows _viewY.._viewY+63 with a virtual canvas
+#define GDDRAM_ROWS 64
+
+// Panel page and segments, not canvas coordinates
+static void ssd1306_dirty_span(SSD1306_t * dev, int page, int start, int end)
+{
+	PAGE_t * p = &dev->_page[page];
+	if (start < p->_dirtyStart) p->_dirtyStart = start;
+	if (end > p->_dirtyEnd) p->_dirtyEnd = end;
+}
+
+static void ssd1306_clean_page(SSD1306_t * dev, int page)
+{
+	dev->_page[page]._dirtyStart = DIRTY_CLEAN_START;
+	dev->_page[page]._dirtyEnd = DIRTY_CLEAN_END;
+}
+
+// Forget pending changes of segments seg..seg+width-1 which were just written to the panel
+static void ssd1306_clean_span(SSD1306_t * dev, int page, int seg, int width)
+{
+	PAGE_t * p = &dev->_page[page];
+	int end = seg + width - 1;
+	if (p->_dirtyStart > p->_dirtyEnd) return;
+	if (seg <= p->_dirtyStart && end >= p->_dirtyEnd) {
+		ssd1306_clean_page(dev, page);
+	} else if (seg <= p->_dirtyStart && end >= p->_dirtyStart) {
+		p->_dirtyStart = end + 1;
+	} else if (seg <= p->_dirtyEnd && end >= p->_dirtyEnd) {
+		p->_dirtyEnd = seg - 1;
+	}
+}
+
+// Positioning commands for a window of GDDRAM. A single page uses page addressing,
+// which needs fewer commands, anything taller uses horizontal addressing, or vertical
+// addressing when the data comes column by column.
+static int ssd1306_window_cmds(SSD1306_t * dev, int page, int pages, int seg, int width, bool vertical, uint8_t * cmds)
+{
+	int n = 0;
+	int mode = (pages == 1) ? OLED_CMD_SET_PAGE_ADDR_MODE : OLED_CMD_SET_HORI_ADDR_MODE;
+	if (vertical && pages > 1) mode = OLED_CMD_SET_VERT_ADDR_MODE;
+	if (dev->_addrMode != mode) {
+		cmds[n++] = OLED_CMD_SET_MEMORY_ADDR_MODE;	// 20
+		cmds[n++] = mode;
+		dev->_addrMode = mode;
+	}
+	int _seg = seg + CONFIG_OFFSETX;
+	if (pages == 1) {
+		// Set Lower Column Start Address for Page Addressing Mode
+		cmds[n++] = 0x00 + (_seg & 0x0F);
+		// Set Higher Column Start Address for Page Addressing Mode
+		cmds[n++] = 0x10 + ((_seg >> 4) & 0x0F);
+		// Set Page Start Address for Page Addressing Mode
+		cmds[n++] = 0xB0 | page;
+	} else {
+		cmds[n++] = OLED_CMD_SET_COLUMN_RANGE;		// 21
+		cmds[n++] = _seg;
+		cmds[n++] = _seg + width - 1;
+		cmds[n++] = OLED_CMD_SET_PAGE_RANGE;		// 22
+		cmds[n++] = page;
+		cmds[n++] = page + pages - 1;
+	}
+	return n;
+}
+
+// Write pages x width segments starting at page/seg, row n read from data + n * stride.
+// async lets the transport return before the data was sent, see ssd1306_wait().
+static void ssd1306_write_window(SSD1306_t * dev, int page, int pages, int seg, int width, const uint8_t * data, int stride, bool async)
+{
+	if (page < 0 || seg < 0) return;
+	if (page + pages > dev->_panelPages) pages = dev->_panelPages - page;
+	if (seg + width > dev->_panelWidth) width = dev->_panelWidth - seg;
+	if (pages <= 0 || width <= 0) return;
+
+	uint8_t cmds[8];
+	int n = ssd1306_window_cmds(dev, page + dev->_pageBase, pages, seg, width, false, cmds);
+	if (async && dev->_ops->flush_async) {
+		dev->_ops->flush_async(dev, cmds, n, data, stride, pages, width);
+	} else {
+		dev->_ops->write_window(dev, cmds, n, data, stride, pages, width);
+	}
+}
+
+// Write a window of fb, which is laid out like _fb. In the column layout a column is
+// contiguous, so the window goes out in vertical addressing with one row per column;
+// it is one transfer for whole columns or a single one, other windows take one per column.
+static void ssd1306_write_fb(SSD1306_t * dev, const uint8_t * fb, int page, int pages, int seg, int width, bool async)
+{
+	if (!dev->_fbColumns) {
+		ssd1306_write_window(dev, page, pages, seg, width, &fb[page * dev->_panelWidth + seg], dev->_panelWidth, async);
+		return;
+	}
+	if (page < 0 || seg < 0) return;
+	if (page + pages > dev->_panelPages) pages = dev->_panelPages - page;
+	if (seg + width > dev->_panelWidth) width = dev->_panelWidth - seg;
+	if (pages <= 0 || width <= 0) return;
+
+	uint8_t cmds[8];
+	int n = ssd1306_window_cmds(dev, page + dev->_pageBase, pages, seg, width, true, cmds);
+	const uint8_t * data = &fb[seg * dev->_panelPages + page];
+	if (async && dev->_ops->flush_async) {
+		dev->_ops->flush_async(dev, cmds, n, data, dev->_panelPages, width, pages);
+	} else {
+		dev->_ops->write_window(dev, cmds, n, data, dev->_panelPages, width, pages);
+	}
+}
 
 void ssd1306_init(SSD1306_t * dev, int width, int height)
 {
-	if (dev->_address == SPIAddress) {
-		spi_init(dev, width, height);
+	dev->_width = width;
+	dev->_height = height;
+	dev->_pages = 8;
+	if (dev->_height == 32) dev->_pages = 4;
+	dev->_panelWidth = dev->_width;
+	dev->_panelPages = dev->_pages;
+	size_t size = dev->_panelWidth * dev->_panelPages;
+	if (dev->_fb && dev->_fbSize < size) {
+		if (dev->_fbOwned) {
+			heap_caps_free(dev->_fb);
+		} else {
+			ESP_LOGE(TAG, "framebuffer of %zu bytes too small, %zu needed", dev->_fbSize, size);
+		}
+		dev->_fb = NULL;
+	}
+	if (dev->_fb == NULL) {
+		dev->_fb = heap_caps_malloc(size, dev->_fbCaps);
+		assert(dev->_fb);
+		dev->_fbSize = size;
+		dev->_fbOwned = true;
+	}
+	if (dev->_canvas) {
+		heap_caps_free(dev->_canvas);
+		dev->_canvas = NULL;
+	}
+	dev->_rotation = ROTATE_0;
+	dev->_virtual = false;
+	dev->_viewX = 0;
+	dev->_viewY = 0;
+	dev->_fbColumns = false;
+	if (dev->_ops->init) dev->_ops->init(dev);
+
+	uint8_t cmds[32];
+	int n = 0;
+	cmds[n++] = OLED_CMD_DISPLAY_OFF;				// AE
+	cmds[n++] = OLED_CMD_SET_MUX_RATIO;				// A8
+	if (dev->_height == 64) cmds[n++] = 0x3F;
+	if (dev->_height == 32) cmds[n++] = 0x1F;
+	cmds[n++] = OLED_CMD_SET_DISPLAY_OFFSET;		// D3
+	cmds[n++] = 0x00;
+	cmds[n++] = OLED_CMD_SET_DISPLAY_START_LINE;	// 40
+	dev->_startLine = 0;
+	dev->_pageFlip = false;
+	dev->_pageBase = 0;
+	// The controller turns the panel upside down, the buffer stays the same
+	if (dev->_flip) {
+		cmds[n++] = OLED_CMD_SET_SEGMENT_REMAP_0;	// A0
+		cmds[n++] = OLED_CMD_SET_COM_SCAN_MODE_0;	// C0
 	} else {
-		i2c_init(dev, width, height);
+		cmds[n++] = OLED_CMD_SET_SEGMENT_REMAP_1;	// A1
+		cmds[n++] = OLED_CMD_SET_COM_SCAN_MODE;		// C8
 	}
+	cmds[n++] = OLED_CMD_SET_DISPLAY_CLK_DIV;		// D5
+	cmds[n++] = 0x80;
+	cmds[n++] = OLED_CMD_SET_COM_PIN_MAP;			// DA
+	if (dev->_height == 64) cmds[n++] = 0x12;
+	if (dev->_height == 32) cmds[n++] = 0x02;
+	cmds[n++] = OLED_CMD_SET_CONTRAST;				// 81
+	cmds[n++] = 0xFF;
+	dev->_contrast = 0xFF;
+	cmds[n++] = OLED_CMD_DISPLAY_RAM;				// A4
+	cmds[n++] = OLED_CMD_SET_VCOMH_DESELCT;			// DB
+	cmds[n++] = 0x40;
+	cmds[n++] = OLED_CMD_SET_MEMORY_ADDR_MODE;		// 20
+	cmds[n++] = OLED_CMD_SET_PAGE_ADDR_MODE;		// 02
+	// Set Lower Column Start Address for Page Addressing Mode
+	cmds[n++] = 0x00;
+	// Set Higher Column Start Address for Page Addressing Mode
+	cmds[n++] = 0x10;
+	dev->_addrMode = OLED_CMD_SET_PAGE_ADDR_MODE;
+	cmds[n++] = OLED_CMD_SET_CHARGE_PUMP;			// 8D
+	cmds[n++] = 0x14;
+	cmds[n++] = OLED_CMD_DEACTIVE_SCROLL;			// 2E
+	cmds[n++] = OLED_CMD_DISPLAY_NORMAL;			// A6
+	cmds[n++] = OLED_CMD_DISPLAY_ON;				// AF
+	dev->_ops->write_cmds(dev, cmds, n);
+#if CONFIG_SSD1306_HW_FADE
+	dev->_hwFade = true;
+#else
+	dev->_hwFade = false;
+#endif
+#if CONFIG_SSD1306_HW_CONTENT_SCROLL
+	dev->_hwContentScroll = true;
+#else
+	dev->_hwContentScroll = false;
+#endif
+	ssd1306_set_font(dev, &ssd1306_font_8x8, 1);
+
 	// Initialize internal buffer
+	// GDDRAM content is undefined after power up, so the first flush sends everything
 	for (int i=0;i<dev->_pages;i++) {
-		memset(dev->_page[i]._segs, 0, 128);
+		ssd1306_mark_dirty(dev, i, 0, dev->_width);
+	}
+	memset(dev->_fb, 0, size);
+}
+
+// Free the framebuffer and the canvas dev owns. Every transport's master_init calls it
+// first, so setting a panel up again does not leak them. Stop the double buffer before.
+// False when dev was never set up, its pointers are then left alone.
+bool ssd1306_release(SSD1306_t * dev)
+{
+	if (dev->_initKey != SSD1306_INIT_KEY(dev)) return false;
+	if (dev->_fb && dev->_fbOwned) heap_caps_free(dev->_fb);
+	if (dev->_canvas) heap_caps_free(dev->_canvas);
+	dev->_fb = NULL;
+	dev->_fbOwned = false;
+	dev->_canvas = NULL;
+	dev->_virtual = false;
+	return true;
+}
+
+// Draw into buffer instead of a framebuffer allocated by ssd1306_init(), which
+// uses the memory the transport asks for (DMA capable on SPI). buffer needs
+// width x pages bytes, call it between the transport's master_init and ssd1306_init().
+// On SPI a buffer outside DMA capable memory costs a copy on every transfer.
+esp_err_t ssd1306_set_framebuffer(SSD1306_t * dev, uint8_t * buffer, size_t size)
+{
+	if (buffer == NULL) return ESP_ERR_INVALID_ARG;
+	if (dev->_fb && dev->_fbOwned) heap_caps_free(dev->_fb);
+	dev->_fb = buffer;
+	dev->_fbSize = size;
+	dev->_fbOwned = false;
+	return ESP_OK;
+}
+
+// Portrait mode. ROTATE_90 and ROTATE_270 give a canvas as wide as the panel is high,
+// which ssd1306_fb() and every drawing function use. Changed 8x8 tiles are transposed
+// into the panel buffer when they are flushed. ROTATE_270 and ROTATE_180 also turn
+// the panel in the controller, see ssd1306_set_flip().
+// The canvas starts blank. Hardware scrolling still moves the panel, not the canvas.
+// Not with the column layout or a virtual canvas.
+esp_err_t ssd1306_set_rotation(SSD1306_t * dev, ssd1306_rotation_t rotation)
+{
+	bool portrait = (rotation == ROTATE_90 || rotation == ROTATE_270);
+	if ((portrait && dev->_fbColumns) || dev->_virtual) return ESP_ERR_NOT_SUPPORTED;
+	if (portrait && dev->_canvas == NULL) {
+		dev->_canvas = heap_caps_calloc(1, dev->_panelWidth * dev->_panelPages, MALLOC_CAP_8BIT);
+		if (dev->_canvas == NULL) return ESP_ERR_NO_MEM;
+	} else if (!portrait && dev->_canvas) {
+		heap_caps_free(dev->_canvas);
+		dev->_canvas = NULL;
+	}
+	dev->_rotation = rotation;
+	if (portrait) {
+		dev->_width = dev->_panelPages * 8;
+		dev->_height = dev->_panelWidth;
+	} else {
+		dev->_width = dev->_panelWidth;
+		dev->_height = dev->_panelPages * 8;
+	}
+	dev->_pages = dev->_height / 8;
+	// Marks the whole panel dirty
+	ssd1306_set_flip(dev, rotation == ROTATE_180 || rotation == ROTATE_270);
+	return ESP_OK;
+}
+
+ssd1306_rotation_t ssd1306_get_rotation(SSD1306_t * dev)
+{
+	return dev->_rotation;
+}
+
+// Bring the panel buffer up to date with the canvas for every dirty tile.
+// Canvas pixel x, y is panel pixel y, (panel height - 1 - x), ROTATE_270 adds the controller flip.
+static void ssd1306_canvas_out(SSD1306_t * dev)
+{
+	if (dev->_canvas == NULL || dev->_virtual) return;
+	for (int page=0; page<dev->_panelPages; page++) {
+		PAGE_t * p = &dev->_page[page];
+		if (p->_dirtyStart > p->_dirtyEnd) continue;
+		// Canvas tile column feeding this panel page
+		int column = (dev->_panelPages - 1 - page) * 8;
+		for (int tile=p->_dirtyStart / 8; tile<=p->_dirtyEnd / 8; tile++) {
+			uint64_t wk;
+			memcpy(&wk, &dev->_canvas[tile * dev->_width + column], 8);
+			// Byte order reversed first, so the panel page reads bottom up
+			wk = ssd1306_transpose8(__builtin_bswap64(wk));
+			memcpy(&dev->_fb[page * dev->_panelWidth + tile * 8], &wk, 8);
+		}
+	}
+}
+
+// Canvas page whose top rows land in GDDRAM page page of the ring. rows of them are inside
+// the ring, the rows below come from the canvas page 64 rows up.
+static int ssd1306_virtual_page(SSD1306_t * dev, int page, int * rows)
+{
+	int y = dev->_viewY + ((page * 8 - dev->_viewY) % GDDRAM_ROWS + GDDRAM_ROWS) % GDDRAM_ROWS;
+	*rows = dev->_viewY + GDDRAM_ROWS - y;
+	return y / 8;
+}
+
+static inline uint8_t ssd1306_virtual_seg(SSD1306_t * dev, int page, int x)
+{
+	if (page < 0 || page >= dev->_pages) return 0;
+	return dev->_canvas[page * dev->_width + x];
+}
+
+// GDDRAM bytes of page for panel segments seg..seg+width-1. Straight from the canvas when
+// the page holds rows of one canvas page, otherwise the two are merged into row.
+static const uint8_t * ssd1306_virtual_row(SSD1306_t * dev, int page, int seg, int width, uint8_t * row)
+{
+	int rows;
+	int lower = ssd1306_virtual_page(dev, page, &rows);
+	int x = dev->_viewX + seg;
+	if (rows >= 8 && lower < dev->_pages) return &dev->_canvas[lower * dev->_width + x];
+	uint8_t mask = (rows >= 8) ? 0xFF : (1 << rows) - 1;
+	for (int i=0; i<width; i++) {
+		row[i] = (ssd1306_virtual_seg(dev, lower, x + i) & mask) | (ssd1306_virtual_seg(dev, lower - 8, x + i) & ~mask);
+	}
+	return row;
+}
+
+// Send the dirty spans of the GDDRAM ring from the virtual canvas. All 8 pages are
+// written on 128x32 panels too, the rows below the panel are shown after a pan.
+static void ssd1306_virtual_flush(SSD1306_t * dev, bool async)
+{
+	uint8_t cmds[8];
+	// The column a pan by one brings in goes out as one vertical window
+	int seg = dev->_page[0]._dirtyStart;
+	bool column = true;
+	for (int page=0; page<8; page++) {
+		if (dev->_page[page]._dirtyStart != seg || dev->_page[page]._dirtyEnd != seg) column = false;
+	}
+	if (column) {
+		uint8_t segs[8];
+		for (int page=0; page<8; page++) {
+			segs[page] = *ssd1306_virtual_row(dev, page, seg, 1, &segs[page]);
+			ssd1306_clean_page(dev, page);
+		}
+		int n = ssd1306_window_cmds(dev, 0, 8, seg, 1, true, cmds);
+		dev->_ops->write_window(dev, cmds, n, segs, 8, 1, 8);
+		return;
+	}
+
+	for (int page=0; page<8; page++) {
+		PAGE_t * p = &dev->_page[page];
+		if (p->_dirtyStart > p->_dirtyEnd) continue;
+		int seg = p->_dirtyStart;
+		int width = p->_dirtyEnd - seg + 1;
+		uint8_t row[128];
+		const uint8_t * data = ssd1306_virtual_row(dev, page, seg, width, row);
+		int n = ssd1306_window_cmds(dev, page, 1, seg, width, false, cmds);
+		// A merged row lives on the stack, it has to be sent before returning
+		if (async && data != row && dev->_ops->flush_async) {
+			dev->_ops->flush_async(dev, cmds, n, data, width, 1, width);
+		} else {
+			dev->_ops->write_window(dev, cmds, n, data, width, 1, width);
+		}
+		ssd1306_clean_page(dev, page);
+	}
+}
+
+// Turn the panel upside down or back. Segment remap only applies to data written
+// after it, so the whole buffer is marked to be sent with the next flush.
+void ssd1306_set_flip(SSD1306_t * dev, bool flip)
+{
+	uint8_t cmds[2];
+	cmds[0] = flip ? OLED_CMD_SET_SEGMENT_REMAP_0 : OLED_CMD_SET_SEGMENT_REMAP_1;
+	cmds[1] = flip ? OLED_CMD_SET_COM_SCAN_MODE_0 : OLED_CMD_SET_COM_SCAN_MODE;
+	dev->_ops->write_cmds(dev, cmds, 2);
+	dev->_flip = flip;
+	// The whole GDDRAM ring with a virtual canvas
+	int pages = dev->_virtual ? GDDRAM_ROWS / 8 : dev->_panelPages;
+	for (int page=0; page<pages; page++) {
+		ssd1306_dirty_span(dev, page, 0, dev->_panelWidth - 1);
 	}
 }
 
@@ -45,149 +405,671 @@ int ssd1306_get_pages(SSD1306_t * dev)
 	return dev->_pages;
 }
 
+// On SPI the frame is only queued, see ssd1306_wait()
 void ssd1306_show_buffer(SSD1306_t * dev)
 {
-	if (dev->_address == SPIAddress) {
-		for (int page=0; page<dev->_pages;page++) {
-			spi_display_image(dev, page, 0, dev->_page[page]._segs, dev->_width);
-		}
-	} else {
-		for (int page=0; page<dev->_pages;page++) {
-			i2c_display_image(dev, page, 0, dev->_page[page]._segs, dev->_width);
+	if (dev->_virtual) {
+		for (int page=0; page<GDDRAM_ROWS / 8;page++) {
+			ssd1306_dirty_span(dev, page, 0, dev->_panelWidth - 1);
 		}
+		ssd1306_virtual_flush(dev, true);
+		return;
+	}
+	for (int page=0; page<dev->_panelPages;page++) {
+		ssd1306_dirty_span(dev, page, 0, dev->_panelWidth - 1);
+	}
+	if (dev->_flushTask) {
+		ssd1306_present(dev, portMAX_DELAY);
+		return;
+	}
+	if (dev->_pageFlip) {
+		ssd1306_flush(dev);
+		return;
+	}
+	ssd1306_canvas_out(dev);
+	ssd1306_write_fb(dev, dev->_fb, 0, dev->_panelPages, 0, dev->_panelWidth, true);
+	for (int page=0; page<dev->_panelPages;page++) {
+		ssd1306_clean_page(dev, page);
 	}
 }
 
-void ssd1306_set_buffer(SSD1306_t * dev, uint8_t * buffer)
+// Bytes beside the payload for a one page and a multi page window on I2C,
+// where they cost the most: address, control and positioning bytes
+#define WINDOW_PAGE_OVERHEAD  (1 + 6 + 1)
+#define WINDOW_RECT_OVERHEAD  (1 + 12 + 1)
+
+// Send the dirty spans of fb, which is either _fb with _page or the double buffer front.
+// Several dirty pages go out as one window when that is cheaper than one transfer per page.
+static void ssd1306_flush_pages(SSD1306_t * dev, const uint8_t * fb, PAGE_t * buf)
 {
-	int index = 0;
-	for (int page=0; page<dev->_pages;page++) {
-		memcpy(&dev->_page[page]._segs, &buffer[index], 128);
-		index = index + 128;
+	int first = -1, last = -1, start = 128, end = -1, cost = 0;
+	for (int page=0; page<dev->_panelPages;page++) {
+		if (buf[page]._dirtyStart > buf[page]._dirtyEnd) continue;
+		if (first < 0) first = page;
+		last = page;
+		if (buf[page]._dirtyStart < start) start = buf[page]._dirtyStart;
+		if (buf[page]._dirtyEnd > end) end = buf[page]._dirtyEnd;
+		cost += buf[page]._dirtyEnd - buf[page]._dirtyStart + 1 + WINDOW_PAGE_OVERHEAD;
+	}
+	if (first < 0) return;
+	if (dev->_fbColumns) {
+		// Whole columns are one transfer, anything less would be one per column
+		first = 0;
+		last = dev->_panelPages - 1;
+	}
+	int pages = last - first + 1;
+	if (dev->_fbColumns || (first != last && pages * (end - start + 1) + WINDOW_RECT_OVERHEAD <= cost)) {
+		ESP_LOGD(TAG, "flush window pages=%d-%d segs=%d-%d", first, last, start, end);
+		ssd1306_write_fb(dev, fb, first, pages, start, end - start + 1, true);
+		for (int page=first; page<=last;page++) {
+			buf[page]._dirtyStart = DIRTY_CLEAN_START;
+			buf[page]._dirtyEnd = DIRTY_CLEAN_END;
+		}
+		return;
+	}
+
+	for (int page=0; page<dev->_panelPages;page++) {
+		int _start = buf[page]._dirtyStart;
+		int _end = buf[page]._dirtyEnd;
+		if (_start > _end) continue;
+		ESP_LOGD(TAG, "flush page=%d start=%d end=%d", page, _start, _end);
+		ssd1306_write_fb(dev, fb, page, 1, _start, _end - _start + 1, true);
+		buf[page]._dirtyStart = DIRTY_CLEAN_START;
+		buf[page]._dirtyEnd = DIRTY_CLEAN_END;
 	}
 }
 
-void ssd1306_get_buffer(SSD1306_t * dev, uint8_t * buffer)
+// Page flipping: write the frame into the hidden half of GDDRAM, then show it with the start line.
+// The hidden half is one frame behind the visible one, so it gets the changes of the last
+// frame as well as the new ones.
+static void ssd1306_flip_pages(SSD1306_t * dev)
 {
-	int index = 0;
-	for (int page=0; page<dev->_pages;page++) {
-		memcpy(&buffer[index], &dev->_page[page]._segs, 128);
-		index = index + 128;
+	PAGE_t changes[4];
+	memcpy(changes, dev->_page, sizeof(changes));
+	bool dirty = false;
+	for (int page=0; page<dev->_panelPages; page++) {
+		PAGE_t * p = &dev->_page[page];
+		PAGE_t * last = &dev->_flipPage[page];
+		if (p->_dirtyStart <= p->_dirtyEnd) dirty = true;
+		if (last->_dirtyStart < p->_dirtyStart) p->_dirtyStart = last->_dirtyStart;
+		if (last->_dirtyEnd > p->_dirtyEnd) p->_dirtyEnd = last->_dirtyEnd;
 	}
+	if (!dirty) return;
+
+	dev->_pageBase = 4 - dev->_pageBase;
+	ssd1306_flush_pages(dev, dev->_fb, dev->_page);
+	// Queued behind the data, the controller switches once the frame is complete
+	dev->_startLine = dev->_pageBase * 8;
+	uint8_t cmd = OLED_CMD_SET_DISPLAY_START_LINE | dev->_startLine;
+	dev->_ops->write_cmds(dev, &cmd, 1);
+	memcpy(dev->_flipPage, changes, sizeof(changes));
 }
 
-void ssd1306_display_image(SSD1306_t * dev, int page, int seg, uint8_t * images, int width)
+// Tear-free updates for 128x32 panels without a second buffer in RAM. The controller has
+// 64 rows of GDDRAM but shows 32, every flush writes the half that is not shown and
+// then flips to it with one command byte. Drawing and flushing work as before, writes
+// that used to go straight to the panel are flushed as a whole frame.
+// Not together with the double buffer.
+esp_err_t ssd1306_page_flip(SSD1306_t * dev, bool enable)
 {
-	if (dev->_address == SPIAddress) {
-		spi_display_image(dev, page, seg, images, width);
-	} else {
-		i2c_display_image(dev, page, seg, images, width);
+	if (dev->_panelPages != 4) return ESP_ERR_NOT_SUPPORTED;
+	if (dev->_flushTask || dev->_virtual) return ESP_ERR_INVALID_STATE;
+	if (enable == dev->_pageFlip) return ESP_OK;
+	if (enable) {
+		// Nothing is known about the hidden half yet
+		for (int page=0; page<dev->_panelPages; page++) {
+			dev->_flipPage[page]._dirtyStart = 0;
+			dev->_flipPage[page]._dirtyEnd = dev->_panelWidth - 1;
+		}
+		dev->_pageFlip = true;
+		return ESP_OK;
 	}
-	// Set to internal buffer
-	memcpy(&dev->_page[page]._segs[seg], images, width);
+	// Back to the lower half
+	if (dev->_pageBase != 0) {
+		ssd1306_mark_dirty(dev, 0, 0, 1);
+		ssd1306_flush(dev);
+	}
+	dev->_pageFlip = false;
+	return ESP_OK;
 }
 
-void ssd1306_display_text(SSD1306_t * dev, int page, char * text, int text_len, bool invert)
+// Draw on a canvas of width x height pixels (height a multiple of 8) larger than the panel,
+// which shows the part chosen with ssd1306_set_viewport(). Every drawing function uses the
+// canvas and flushes send straight from it. GDDRAM is kept as a ring of 64 canvas rows from
+// the top of the viewport, so a vertical pan sends only the pages of the rows it brings in
+// and moves the display start line. 0 x 0 goes back to the panel buffer as it was.
+// Not in portrait mode, with the column layout, page flipping or the double buffer.
+esp_err_t ssd1306_set_virtual(SSD1306_t * dev, int width, int height)
 {
-	if (page >= dev->_pages) return;
-	int _text_len = text_len;
-	if (_text_len > 16) _text_len = 16;
+	if (dev->_flushTask || dev->_pageFlip) return ESP_ERR_INVALID_STATE;
+	if ((dev->_canvas && !dev->_virtual) || dev->_fbColumns) return ESP_ERR_NOT_SUPPORTED;
+	bool off = (width == 0 && height == 0);
+	if (!off && (width < dev->_panelWidth || height < dev->_panelPages * 8 || height % 8)) return ESP_ERR_INVALID_ARG;
+	uint8_t * canvas = NULL;
+	if (!off) {
+		canvas = heap_caps_calloc(1, width * (height / 8), MALLOC_CAP_8BIT);
+		if (canvas == NULL) return ESP_ERR_NO_MEM;
+	}
+	if (dev->_canvas) heap_caps_free(dev->_canvas);
+	dev->_canvas = canvas;
+	dev->_virtual = !off;
+	dev->_viewX = 0;
+	dev->_viewY = 0;
+	dev->_width = off ? dev->_panelWidth : width;
+	dev->_height = off ? dev->_panelPages * 8 : height;
+	dev->_pages = dev->_height / 8;
+
+	dev->_startLine = 0;
+	uint8_t cmd = OLED_CMD_SET_DISPLAY_START_LINE;
+	dev->_ops->write_cmds(dev, &cmd, 1);
+	// The blank canvas or the panel buffer goes out with the next flush
+	for (int page=0; page<GDDRAM_ROWS / 8; page++) {
+		ssd1306_clean_page(dev, page);
+	}
+	int pages = dev->_virtual ? GDDRAM_ROWS / 8 : dev->_panelPages;
+	for (int page=0; page<pages; page++) {
+		ssd1306_dirty_span(dev, page, 0, dev->_panelWidth - 1);
+	}
+	return ESP_OK;
+}
 
-	uint8_t seg = 0;
-	uint8_t image[8];
-	for (uint8_t i = 0; i < _text_len; i++) {
-		memcpy(image, font8x8_basic_tr[(uint8_t)text[i]], 8);
-		if (invert) ssd1306_invert(image, 8);
-		if (dev->_flip) ssd1306_flip(image, 8);
-		ssd1306_display_image(dev, page, seg, image, 8);
-#if 0
-		if (dev->_address == SPIAddress) {
-			spi_display_image(dev, page, seg, image, 8);
-		} else {
-			i2c_display_image(dev, page, seg, image, 8);
+// Show the virtual canvas from column x, row y at the top left of the panel, clamped to the canvas.
+// Pending drawing is sent first, then only what the pan brings in: the pages of the new rows
+// and, for a pan by one column, that column behind the content scroll (2C/2D,
+// CONFIG_SSD1306_HW_CONTENT_SCROLL). The controller has no column offset, wider pans send the
+// panel again, straight from the canvas. Leave two frames between pans by one column.
+esp_err_t ssd1306_set_viewport(SSD1306_t * dev, int x, int y)
+{
+	if (!dev->_virtual) return ESP_ERR_INVALID_STATE;
+	if (x > dev->_width - dev->_panelWidth) x = dev->_width - dev->_panelWidth;
+	if (y > dev->_height - dev->_panelPages * 8) y = dev->_height - dev->_panelPages * 8;
+	if (x < 0) x = 0;
+	if (y < 0) y = 0;
+	int dx = x - dev->_viewX;
+	int dy = y - dev->_viewY;
+	if (dx == 0 && dy == 0) return ESP_OK;
+	// Drawn for the old viewport
+	ssd1306_virtual_flush(dev, false);
+
+	if ((dx == 1 || dx == -1) && dev->_hwContentScroll) {
+		uint8_t cmds[7];
+		cmds[0] = (dx > 0) ? OLED_CMD_CONTENT_LEFT : OLED_CMD_CONTENT_RIGHT;
+		cmds[1] = 0x00; // Dummy byte
+		cmds[2] = 0x00; // Start page
+		cmds[3] = 0x01; // Dummy byte
+		cmds[4] = GDDRAM_ROWS / 8 - 1; // End page
+		cmds[5] = CONFIG_OFFSETX;
+		cmds[6] = dev->_panelWidth - 1 + CONFIG_OFFSETX;
+		dev->_ops->write_cmds(dev, cmds, 7);
+		int in = (dx > 0) ? dev->_panelWidth - 1 : 0;
+		for (int page=0; page<GDDRAM_ROWS / 8; page++) {
+			ssd1306_dirty_span(dev, page, in, in);
 		}
-#endif
-		seg = seg + 8;
+	} else if (dx != 0) {
+		for (int page=0; page<GDDRAM_ROWS / 8; page++) {
+			ssd1306_dirty_span(dev, page, 0, dev->_panelWidth - 1);
+		}
+	}
+	dev->_viewX = x;
+
+	if (dy != 0) {
+		// Canvas rows entering the ring
+		int first = (dy > 0) ? dev->_viewY + GDDRAM_ROWS : y;
+		int last = (dy > 0) ? y + GDDRAM_ROWS - 1 : dev->_viewY - 1;
+		if (first < y) first = y;
+		if (last > y + GDDRAM_ROWS - 1) last = y + GDDRAM_ROWS - 1;
+		dev->_viewY = y;
+		for (int page=first / 8; page<=last / 8; page++) {
+			ssd1306_mark_dirty(dev, page, x, dev->_panelWidth);
+		}
+	}
+	ssd1306_virtual_flush(dev, true);
+	if (dy != 0) {
+		// Behind the new rows, the panel moves once they are in GDDRAM
+		dev->_startLine = dev->_viewY % GDDRAM_ROWS;
+		uint8_t cmd = OLED_CMD_SET_DISPLAY_START_LINE | dev->_startLine;
+		dev->_ops->write_cmds(dev, &cmd, 1);
 	}
+	return ESP_OK;
 }
 
-// by Coert Vonk
-void 
-ssd1306_display_text_x3(SSD1306_t * dev, int page, char * text, int text_len, bool invert)
+void ssd1306_get_viewport(SSD1306_t * dev, int * x, int * y)
 {
-	if (page >= dev->_pages) return;
-	int _text_len = text_len;
-	if (_text_len > 5) _text_len = 5;
+	*x = dev->_viewX;
+	*y = dev->_viewY;
+}
 
-	uint8_t seg = 0;
+// Send only the segments changed since the last transfer.
+// With the double buffer running this hands the changes to the flush task instead.
+void ssd1306_flush(SSD1306_t * dev)
+{
+	if (dev->_flushTask) {
+		ssd1306_present(dev, portMAX_DELAY);
+		return;
+	}
+	if (dev->_virtual) {
+		ssd1306_virtual_flush(dev, true);
+		return;
+	}
+	ssd1306_canvas_out(dev);
+	if (dev->_pageFlip) {
+		ssd1306_flip_pages(dev);
+		return;
+	}
+	ssd1306_flush_pages(dev, dev->_fb, dev->_page);
+}
 
-	for (uint8_t nn = 0; nn < _text_len; nn++) {
+static void ssd1306_flush_task(void * arg)
+{
+	SSD1306_t * dev = (SSD1306_t *)arg;
+	while (1) {
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		if (dev->_flushStop) break;
+		ssd1306_flush_pages(dev, dev->_front, dev->_frontPage);
+		// The front buffer may only change after the last DMA read of it
+		ssd1306_wait(dev);
+		dev->_frontPending = false;
+		xSemaphoreGive(dev->_frontFree);
+	}
+	xSemaphoreGive(dev->_frontFree);
+	vTaskDelete(NULL);
+}
 
-		uint8_t const * const in_columns = font8x8_basic_tr[(uint8_t)text[nn]];
+// Front buffer holding what is pending in the back buffer, sent by the first notification
+static esp_err_t ssd1306_front_init(SSD1306_t * dev)
+{
+	dev->_front = heap_caps_malloc(dev->_panelPages * dev->_panelWidth, dev->_fbCaps);
+	if (dev->_front == NULL) return ESP_ERR_NO_MEM;
+	dev->_frontFree = xSemaphoreCreateBinary();
+	if (dev->_frontFree == NULL) {
+		heap_caps_free(dev->_front);
+		dev->_front = NULL;
+		return ESP_ERR_NO_MEM;
+	}
+	ssd1306_canvas_out(dev);
+	memcpy(dev->_front, dev->_fb, dev->_panelPages * dev->_panelWidth);
+	memcpy(dev->_frontPage, dev->_page, sizeof(dev->_page));
+	for (int page=0; page<dev->_panelPages;page++) {
+		ssd1306_clean_page(dev, page);
+	}
+	dev->_frontPending = true;
+	return ESP_OK;
+}
 
-		// make the character 3x as high
-		out_column_t out_columns[8];
-		memset(out_columns, 0, sizeof(out_columns));
+static void ssd1306_front_free(SSD1306_t * dev)
+{
+	dev->_flushTask = NULL;
+	dev->_sched = NULL;
+	vSemaphoreDelete(dev->_frontFree);
+	heap_caps_free(dev->_front);
+	dev->_front = NULL;
+}
 
-		for (uint8_t xx = 0; xx < 8; xx++) { // for each column (x-direction)
+// Opt-in double buffering. Drawing keeps going to _fb (the back buffer) and
+// ssd1306_present() hands the changes to a task pinned to core (or tskNO_AFFINITY)
+// which streams them while the caller draws the next frame.
+// While it runs only framebuffer drawing, flush, show_buffer and present may be used,
+// functions writing straight to the panel would race with the flush task.
+esp_err_t ssd1306_double_buffer_start(SSD1306_t * dev, UBaseType_t priority, BaseType_t core)
+{
+	if (dev->_flushTask || dev->_pageFlip || dev->_virtual) return ESP_ERR_INVALID_STATE;
+	esp_err_t ret = ssd1306_front_init(dev);
+	if (ret != ESP_OK) return ret;
+	dev->_flushStop = false;
+	if (xTaskCreatePinnedToCore(ssd1306_flush_task, "ssd1306_flush", 3072, dev, priority, &dev->_flushTask, core) != pdPASS) {
+		ssd1306_front_free(dev);
+		return ESP_ERR_NO_MEM;
+	}
+	// Whatever was pending in the back buffer goes out first
+	xTaskNotifyGive(dev->_flushTask);
+	return ESP_OK;
+}
 
-			uint32_t in_bitmask = 0b1;
-			uint32_t out_bitmask = 0b111;
+// Wait for the current frame to finish and go back to synchronous transfers.
+// Panels of a scheduler are stopped with ssd1306_scheduler_stop().
+void ssd1306_double_buffer_stop(SSD1306_t * dev)
+{
+	if (dev->_flushTask == NULL) return;
+	if (dev->_sched) {
+		ESP_LOGE(TAG, "panel belongs to a scheduler, see ssd1306_scheduler_stop()");
+		return;
+	}
+	xSemaphoreTake(dev->_frontFree, portMAX_DELAY);
+	dev->_flushStop = true;
+	xTaskNotifyGive(dev->_flushTask);
+	xSemaphoreTake(dev->_frontFree, portMAX_DELAY);
+	ssd1306_front_free(dev);
+}
+
+// Send the first dirty page of fb, false when none is left.
+// The column layout sends all dirty columns at once.
+static bool ssd1306_flush_next_page(SSD1306_t * dev, const uint8_t * fb, PAGE_t * buf)
+{
+	if (dev->_fbColumns) {
+		bool dirty = false;
+		for (int page=0; page<dev->_panelPages;page++) {
+			if (buf[page]._dirtyStart <= buf[page]._dirtyEnd) dirty = true;
+		}
+		if (dirty) ssd1306_flush_pages(dev, fb, buf);
+		return dirty;
+	}
+	for (int page=0; page<dev->_panelPages;page++) {
+		int _start = buf[page]._dirtyStart;
+		int _end = buf[page]._dirtyEnd;
+		if (_start > _end) continue;
+		ssd1306_write_fb(dev, fb, page, 1, _start, _end - _start + 1, true);
+		buf[page]._dirtyStart = DIRTY_CLEAN_START;
+		buf[page]._dirtyEnd = DIRTY_CLEAN_END;
+		return true;
+	}
+	return false;
+}
 
-			for (uint8_t yy = 0; yy < 8; yy++) { // for pixel (y-direction)
-				if (in_columns[xx] & in_bitmask) {
-					out_columns[xx].u32 |= out_bitmask;
+static void ssd1306_scheduler_task(void * arg)
+{
+	ssd1306_scheduler_t * sched = (ssd1306_scheduler_t *)arg;
+	while (1) {
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		if (sched->stop) break;
+		// One page per panel and round, a full frame on one panel does not hold up the others
+		bool busy = true;
+		while (busy) {
+			busy = false;
+			for (int i=0; i<sched->count; i++) {
+				SSD1306_t * dev = sched->devs[i];
+				if (!dev->_frontPending) continue;
+				if (ssd1306_flush_next_page(dev, dev->_front, dev->_frontPage)) {
+					busy = true;
+					continue;
 				}
-				in_bitmask <<= 1;
-				out_bitmask <<= 3;
+				ssd1306_wait(dev);
+				dev->_frontPending = false;
+				xSemaphoreGive(dev->_frontFree);
 			}
 		}
+	}
+	xSemaphoreGive(sched->done);
+	vTaskDelete(NULL);
+}
+
+// Double buffering for several panels with one task, which interleaves their
+// transfers page by page. Panels on one bus (I2C addresses or SPI CS lines) then
+// share it fairly instead of one frame after the other. Each panel is drawn and
+// presented as with ssd1306_double_buffer_start().
+esp_err_t ssd1306_scheduler_start(ssd1306_scheduler_t * sched, UBaseType_t priority, BaseType_t core)
+{
+	memset(sched, 0, sizeof(ssd1306_scheduler_t));
+	sched->done = xSemaphoreCreateBinary();
+	if (sched->done == NULL) return ESP_ERR_NO_MEM;
+	if (xTaskCreatePinnedToCore(ssd1306_scheduler_task, "ssd1306_sched", 3072, sched, priority, &sched->task, core) != pdPASS) {
+		vSemaphoreDelete(sched->done);
+		return ESP_ERR_NO_MEM;
+	}
+	return ESP_OK;
+}
 
-		// render character in 8 column high pieces, making them 3x as wide
-		for (uint8_t yy = 0; yy < 3; yy++)	{ // for each group of 8 pixels high (y-direction)
+// Hand dev over to the scheduler, call it after ssd1306_init()
+esp_err_t ssd1306_scheduler_add(ssd1306_scheduler_t * sched, SSD1306_t * dev)
+{
+	if (dev->_flushTask || dev->_pageFlip || dev->_virtual) return ESP_ERR_INVALID_STATE;
+	if (sched->count == SSD1306_SCHEDULER_SIZE) return ESP_ERR_NO_MEM;
+	esp_err_t ret = ssd1306_front_init(dev);
+	if (ret != ESP_OK) return ret;
+	dev->_flushTask = sched->task;
+	dev->_sched = sched;
+	sched->devs[sched->count] = dev;
+	sched->count++;
+	xTaskNotifyGive(sched->task);
+	return ESP_OK;
+}
 
-			uint8_t image[24];
-			for (uint8_t xx = 0; xx < 8; xx++) { // for each column (x-direction)
-				image[xx*3+0] = 
-				image[xx*3+1] = 
-				image[xx*3+2] = out_columns[xx].u8[yy];
-			}
-			if (invert) ssd1306_invert(image, 24);
-			if (dev->_flip) ssd1306_flip(image, 24);
-			if (dev->_address == SPIAddress) {
-				spi_display_image(dev, page+yy, seg, image, 24);
-			} else {
-				i2c_display_image(dev, page+yy, seg, image, 24);
-			}
-			memcpy(&dev->_page[page+yy]._segs[seg], image, 24);
+// Wait for every panel to finish its frame, then stop the task. The panels go back to synchronous transfers.
+void ssd1306_scheduler_stop(ssd1306_scheduler_t * sched)
+{
+	for (int i=0; i<sched->count; i++) {
+		xSemaphoreTake(sched->devs[i]->_frontFree, portMAX_DELAY);
+	}
+	sched->stop = true;
+	xTaskNotifyGive(sched->task);
+	xSemaphoreTake(sched->done, portMAX_DELAY);
+	vSemaphoreDelete(sched->done);
+	for (int i=0; i<sched->count; i++) {
+		ssd1306_front_free(sched->devs[i]);
+	}
+	sched->count = 0;
+}
+
+// Copy the changed spans of the back buffer to the front buffer and wake the flush task.
+// Waits up to wait ticks for the previous frame to leave the front buffer; when it is
+// still busy returns false and the changes stay pending for the next call.
+bool ssd1306_present(SSD1306_t * dev, TickType_t wait)
+{
+	if (dev->_flushTask == NULL) {
+		ssd1306_flush(dev);
+		return true;
+	}
+	ssd1306_canvas_out(dev);
+	if (xSemaphoreTake(dev->_frontFree, wait) != pdTRUE) return false;
+	if (dev->_fbColumns) {
+		// Whole columns, a page of them is not contiguous
+		int start = dev->_panelWidth, end = -1;
+		for (int page=0; page<dev->_panelPages;page++) {
+			if (dev->_page[page]._dirtyStart < start) start = dev->_page[page]._dirtyStart;
+			if (dev->_page[page]._dirtyEnd > end) end = dev->_page[page]._dirtyEnd;
+		}
+		if (start <= end) {
+			int offset = start * dev->_panelPages;
+			memcpy(&dev->_front[offset], &dev->_fb[offset], (end - start + 1) * dev->_panelPages);
 		}
-		seg = seg + 24;
 	}
+	for (int page=0; page<dev->_panelPages;page++) {
+		PAGE_t * back = &dev->_page[page];
+		PAGE_t * front = &dev->_frontPage[page];
+		if (back->_dirtyStart > back->_dirtyEnd) continue;
+		if (!dev->_fbColumns) {
+			int offset = page * dev->_panelWidth + back->_dirtyStart;
+			memcpy(&dev->_front[offset], &dev->_fb[offset], back->_dirtyEnd - back->_dirtyStart + 1);
+		}
+		if (back->_dirtyStart < front->_dirtyStart) front->_dirtyStart = back->_dirtyStart;
+		if (back->_dirtyEnd > front->_dirtyEnd) front->_dirtyEnd = back->_dirtyEnd;
+		ssd1306_clean_page(dev, page);
+	}
+	dev->_frontPending = true;
+	xTaskNotifyGive(dev->_flushTask);
+	return true;
 }
 
-void ssd1306_clear_screen(SSD1306_t * dev, bool invert)
+// Block until queued transfers left the bus. SPI and the asynchronous I2C transport
+// (CONFIG_SSD1306_I2C_ASYNC) queue them, the blocking I2C transport completes them before returning.
+// Call it before changing buffer contents that must not show up half drawn.
+void ssd1306_wait(SSD1306_t * dev)
 {
-	char space[16];
-	memset(space, 0x00, sizeof(space));
-	for (int page = 0; page < dev->_pages; page++) {
-		ssd1306_display_text(dev, page, space, sizeof(space), invert);
+	if (dev->_ops->wait) dev->_ops->wait(dev);
+}
+
+// done gets the result of every I2C transfer, errors included. NULL turns it off.
+void ssd1306_set_transfer_callback(SSD1306_t * dev, ssd1306_transfer_cb_t done, void * arg)
+{
+	dev->_transferDone = NULL;
+	dev->_transferArg = arg;
+	dev->_transferDone = done;
+}
+
+// Send the pages covering rows y..y+height-1, segments x..x+width-1 as one window
+// and wait for it, other dirty areas stay pending.
+// With the double buffer running the area is handed to the flush task instead.
+void ssd1306_flush_rect(SSD1306_t * dev, int x, int y, int width, int height)
+{
+	if (x < 0) { width += x; x = 0; }
+	if (y < 0) { height += y; y = 0; }
+	if (x + width > dev->_width) width = dev->_width - x;
+	if (y + height > dev->_height) height = dev->_height - y;
+	if (width <= 0 || height <= 0) return;
+	if (dev->_canvas || dev->_flushTask || dev->_pageFlip) {
+		for (int page=y / 8; page<=(y + height - 1) / 8; page++) {
+			ssd1306_mark_dirty(dev, page, x, width);
+		}
+	}
+	if (dev->_flushTask) {
+		ssd1306_present(dev, portMAX_DELAY);
+		return;
+	}
+	if (dev->_pageFlip) {
+		// The whole frame flips, other pending changes go along
+		ssd1306_flush(dev);
+		return;
+	}
+	if (dev->_virtual) {
+		ssd1306_virtual_flush(dev, false);
+		return;
+	}
+	if (dev->_canvas) {
+		// Same area on the panel, rounded to whole tiles
+		ssd1306_canvas_out(dev);
+		int _x = (y / 8) * 8;
+		int _y = dev->_panelPages * 8 - ((x + width + 7) / 8) * 8;
+		int _width = ((y + height + 7) / 8) * 8 - _x;
+		int _height = ((x + width + 7) / 8) * 8 - (x / 8) * 8;
+		x = _x;
+		y = _y;
+		width = _width;
+		height = _height;
+	}
+	int first = y / 8;
+	int last = (y + height - 1) / 8;
+	if (dev->_fbColumns && width > 1) {
+		// Whole columns are one transfer
+		first = 0;
+		last = dev->_panelPages - 1;
+	}
+	ssd1306_write_fb(dev, dev->_fb, first, last - first + 1, x, width, false);
+	for (int page=first; page<=last; page++) {
+		ssd1306_clean_span(dev, page, x, width);
 	}
 }
 
-void ssd1306_clear_line(SSD1306_t * dev, int page, bool invert)
+// Remember that segments seg..seg+width-1 of page differ from the panel.
+// In portrait mode page and seg are canvas coordinates.
+void ssd1306_mark_dirty(SSD1306_t * dev, int page, int seg, int width)
+{
+	if (page < 0 || page >= dev->_pages || width <= 0) return;
+	int end = seg + width - 1;
+	if (seg < 0) seg = 0;
+	if (end >= dev->_width) end = dev->_width - 1;
+	if (seg > end) return;
+	if (dev->_canvas == NULL) {
+		ssd1306_dirty_span(dev, page, seg, end);
+		return;
+	}
+	if (dev->_virtual) {
+		// Rows outside the GDDRAM ring are sent by the pan bringing them in
+		if (page * 8 + 7 < dev->_viewY || page * 8 >= dev->_viewY + GDDRAM_ROWS) return;
+		seg -= dev->_viewX;
+		end -= dev->_viewX;
+		if (seg < 0) seg = 0;
+		if (end >= dev->_panelWidth) end = dev->_panelWidth - 1;
+		if (seg <= end) ssd1306_dirty_span(dev, page % (GDDRAM_ROWS / 8), seg, end);
+		return;
+	}
+	// The 8 canvas rows of page are panel segments, canvas columns are panel pages
+	for (int _page=dev->_panelPages - 1 - end / 8; _page<=dev->_panelPages - 1 - seg / 8; _page++) {
+		ssd1306_dirty_span(dev, _page, page * 8, page * 8 + 7);
+	}
+}
+
+// Copy width bytes of src into segments seg.. of page
+static void ssd1306_fb_put(SSD1306_t * dev, int page, int seg, const uint8_t * src, int width)
 {
-	char space[16];
-	memset(space, 0x00, sizeof(space));
-	ssd1306_display_text(dev, page, space, sizeof(space), invert);
+	if (!dev->_fbColumns) {
+		memcpy(&ssd1306_fb(dev, page)[seg], src, width);
+		return;
+	}
+	for (int i=0; i<width; i++) {
+		*ssd1306_fb_seg(dev, page, seg + i) = src[i];
+	}
 }
 
-void ssd1306_contrast(SSD1306_t * dev, int contrast)
+// buffer holds the pages one after the other, _width bytes each. Only the span of each
+// page that differs from the current buffer is copied and sent with the next flush.
+// Passing the framebuffer itself (see ssd1306_set_framebuffer()) copies nothing,
+// it marks everything to be sent; it is then in the layout of ssd1306_set_layout().
+void ssd1306_set_buffer(SSD1306_t * dev, uint8_t * buffer)
 {
-	if (dev->_address == SPIAddress) {
-		spi_contrast(dev, contrast);
+	uint8_t * fb = ssd1306_fb(dev, 0);
+	for (int page=0; page<dev->_pages;page++) {
+		const uint8_t * src = &buffer[page * dev->_width];
+		int first, last;
+		if (buffer == fb || dev->_fbColumns) {
+			if (buffer != fb) ssd1306_fb_put(dev, page, 0, src, dev->_width);
+			ssd1306_mark_dirty(dev, page, 0, dev->_width);
+		} else if (ssd1306_diff_span(ssd1306_fb(dev, page), src, dev->_width, &first, &last)) {
+			memcpy(&ssd1306_fb(dev, page)[first], &src[first], last - first + 1);
+			ssd1306_mark_dirty(dev, page, first, last - first + 1);
+		}
+	}
+}
+
+void ssd1306_get_buffer(SSD1306_t * dev, uint8_t * buffer)
+{
+	if (!dev->_fbColumns) {
+		memcpy(buffer, ssd1306_fb(dev, 0), dev->_pages * dev->_width);
+		return;
+	}
+	for (int page=0; page<dev->_pages;page++) {
+		for (int seg=0; seg<dev->_width; seg++) {
+			buffer[page * dev->_width + seg] = *ssd1306_fb_seg(dev, page, seg);
+		}
+	}
+}
+
+void ssd1306_display_image(SSD1306_t * dev, int page, int seg, uint8_t * images, int width)
+{
+	if (page >= dev->_pages) return;
+	if (seg >= dev->_width) return;
+	if (dev->_canvas || dev->_pageFlip) {
+		if (seg + width > dev->_width) width = dev->_width - seg;
+		ssd1306_fb_put(dev, page, seg, images, width);
+		ssd1306_flush_rect(dev, seg, page * 8, width, 8);
+		return;
+	}
+	ssd1306_write_window(dev, page, 1, seg, width, images, width, false);
+	// Set to internal buffer
+	if (seg + width > dev->_width) width = dev->_width - seg;
+	ssd1306_fb_put(dev, page, seg, images, width);
+	ssd1306_clean_span(dev, page, seg, width);
+}
+
+void ssd1306_clear_screen(SSD1306_t * dev, bool invert)
+{
+	// Every page in either layout
+	memset(ssd1306_fb(dev, 0), invert ? 0xFF : 0x00, dev->_pages * dev->_width);
+	ssd1306_flush_rect(dev, 0, 0, dev->_width, dev->_height);
+}
+
+void ssd1306_clear_line(SSD1306_t * dev, int page, bool invert)
+{
+	if (page < 0 || page >= dev->_pages) return;
+	if (dev->_fbColumns) {
+		for (int seg=0; seg<dev->_width; seg++) {
+			*ssd1306_fb_seg(dev, page, seg) = invert ? 0xFF : 0x00;
+		}
 	} else {
-		i2c_contrast(dev, contrast);
+		memset(ssd1306_fb(dev, page), invert ? 0xFF : 0x00, dev->_width);
 	}
+	ssd1306_flush_rect(dev, 0, page * 8, dev->_width, 8);
+}
+
+void ssd1306_contrast(SSD1306_t * dev, int contrast)
+{
+	int _contrast = contrast;
+	if (contrast < 0x0) _contrast = 0;
+	if (contrast > 0xFF) _contrast = 0xFF;
+
+	uint8_t cmds[2];
+	cmds[0] = OLED_CMD_SET_CONTRAST;				// 81
+	cmds[1] = _contrast;
+	dev->_ops->write_cmds(dev, cmds, 2);
+	dev->_contrast = _contrast;
 }
 
 void ssd1306_software_scroll(SSD1306_t * dev, int start, int end)
@@ -212,24 +1094,24 @@ void ssd1306_scroll_text(SSD1306_t * dev, char * text, int text_len, bool invert
 	ESP_LOGD(TAG, "dev->_scEnable=%d", dev->_scEnable);
 	if (dev->_scEnable == false) return;
 
-	void (*func)(SSD1306_t * dev, int page, int seg, uint8_t * images, int width);
-	if (dev->_address == SPIAddress) {
-		func = spi_display_image;
-	} else {
-		func = i2c_display_image;
-	}
-
 	int srcIndex = dev->_scEnd - dev->_scDirection;
 	while(1) {
 		int dstIndex = srcIndex + dev->_scDirection;
 		ESP_LOGD(TAG, "srcIndex=%d dstIndex=%d", srcIndex,dstIndex);
-		for(int seg = 0; seg < dev->_width; seg++) {
-			dev->_page[dstIndex]._segs[seg] = dev->_page[srcIndex]._segs[seg];
+		if (dev->_fbColumns) {
+			// Sent below in one go, a page of whole columns is the whole panel
+			for (int seg=0; seg<dev->_width; seg++) {
+				*ssd1306_fb_seg(dev, dstIndex, seg) = *ssd1306_fb_seg(dev, srcIndex, seg);
+			}
+			ssd1306_mark_dirty(dev, dstIndex, 0, dev->_width);
+		} else {
+			memcpy(ssd1306_fb(dev, dstIndex), ssd1306_fb(dev, srcIndex), dev->_width);
+			ssd1306_flush_rect(dev, 0, dstIndex * 8, dev->_width, 8);
 		}
-		(*func)(dev, dstIndex, 0, dev->_page[dstIndex]._segs, sizeof(dev->_page[dstIndex]._segs));
 		if (srcIndex == dev->_scStart) break;
 		srcIndex = srcIndex - dev->_scDirection;
 	}
+	if (dev->_fbColumns) ssd1306_flush_rect(dev, 0, 0, dev->_width, dev->_height);
 	
 	int _text_len = text_len;
 	if (_text_len > 16) _text_len = 16;
@@ -255,11 +1137,120 @@ void ssd1306_scroll_clear(SSD1306_t * dev)
 
 void ssd1306_hardware_scroll(SSD1306_t * dev, ssd1306_scroll_type_t scroll)
 {
-	if (dev->_address == SPIAddress) {
-		spi_hardware_scroll(dev, scroll);
-	} else {
-		i2c_hardware_scroll(dev, scroll);
+	uint8_t cmds[16];
+	int n = 0;
+
+	if (scroll == SCROLL_RIGHT || scroll == SCROLL_LEFT) {
+		if (scroll == SCROLL_RIGHT) cmds[n++] = OLED_CMD_HORIZONTAL_RIGHT;	// 26
+		if (scroll == SCROLL_LEFT) cmds[n++] = OLED_CMD_HORIZONTAL_LEFT;	// 27
+		cmds[n++] = 0x00; // Dummy byte
+		cmds[n++] = 0x00; // Define start page address
+		cmds[n++] = 0x07; // Frame frequency
+		cmds[n++] = 0x07; // Define end page address
+		cmds[n++] = 0x00; //
+		cmds[n++] = 0xFF; //
+		cmds[n++] = OLED_CMD_ACTIVE_SCROLL;		// 2F
+	}
+
+	if (scroll == SCROLL_DOWN || scroll == SCROLL_UP) {
+		cmds[n++] = OLED_CMD_CONTINUOUS_SCROLL;	// 29
+		cmds[n++] = 0x00; // Dummy byte
+		cmds[n++] = 0x00; // Define start page address
+		cmds[n++] = 0x07; // Frame frequency
+		cmds[n++] = 0x00; // Define end page address
+		if (scroll == SCROLL_DOWN) cmds[n++] = 0x3F; // Vertical scrolling offset
+		if (scroll == SCROLL_UP) cmds[n++] = 0x01; // Vertical scrolling offset
+
+		cmds[n++] = OLED_CMD_VERTICAL;			// A3
+		cmds[n++] = 0x00;
+		if (dev->_height == 64) cmds[n++] = 0x40;
+		if (dev->_height == 32) cmds[n++] = 0x20;
+		cmds[n++] = OLED_CMD_ACTIVE_SCROLL;		// 2F
 	}
+
+	if (scroll == SCROLL_STOP) {
+		cmds[n++] = OLED_CMD_DEACTIVE_SCROLL;	// 2E
+	}
+
+	if (n) dev->_ops->write_cmds(dev, cmds, n);
+}
+
+// Pan the picture up by lines rows (down when negative) with the display start line:
+// one command byte and no GDDRAM traffic. GDDRAM is a ring of 64 rows, the rows leaving
+// the top come back in at the bottom. Draw what should appear there at buffer row
+// ssd1306_vscroll_y() and flush, only the pages holding those rows are sent.
+// Needs a 64 row panel without portrait rotation.
+esp_err_t ssd1306_vscroll(SSD1306_t * dev, int lines)
+{
+	if (dev->_panelPages != 8 || dev->_canvas) return ESP_ERR_NOT_SUPPORTED;
+	int rows = dev->_panelPages * 8;
+	dev->_startLine = ((dev->_startLine + lines) % rows + rows) % rows;
+	uint8_t cmd = OLED_CMD_SET_DISPLAY_START_LINE | dev->_startLine;
+	dev->_ops->write_cmds(dev, &cmd, 1);
+	return ESP_OK;
+}
+
+// Buffer row shown at panel row y after ssd1306_vscroll()
+int ssd1306_vscroll_y(SSD1306_t * dev, int y)
+{
+	int rows = dev->_panelPages * 8;
+	return ((y + dev->_startLine) % rows + rows) % rows;
+}
+
+// Marquee step: move segments first..last of pages start..end one column left or right
+// and bring in column, one byte per page, at the edge the content moved away from.
+// With the content scroll of the controller (2C/2D, CONFIG_SSD1306_HW_CONTENT_SCROLL) only the
+// new column is written, otherwise the whole area is sent again. The controller moves the
+// content during a refresh, leave two frames between steps (about 20ms on a 64 row panel).
+// Not in portrait mode and not with ssd1306_hardware_scroll() running.
+esp_err_t ssd1306_ticker_step(SSD1306_t * dev, ssd1306_scroll_type_t scroll, int start, int end, int first, int last, const uint8_t * column)
+{
+	if (dev->_canvas) return ESP_ERR_NOT_SUPPORTED;
+	if (scroll != SCROLL_LEFT && scroll != SCROLL_RIGHT) return ESP_ERR_INVALID_ARG;
+	if (end >= dev->_pages) end = dev->_pages - 1;
+	if (last >= dev->_width) last = dev->_width - 1;
+	if (start < 0 || first < 0 || start > end || first >= last) return ESP_ERR_INVALID_ARG;
+
+	// Changes not sent yet would be moved on the panel with everything else
+	bool pending = false;
+	for (int page=start; page<=end; page++) {
+		if (dev->_page[page]._dirtyStart <= last && dev->_page[page]._dirtyEnd >= first) pending = true;
+	}
+
+	int in = (scroll == SCROLL_LEFT) ? last : first;
+	for (int page=start; page<=end; page++) {
+		if (dev->_fbColumns) {
+			int step = (scroll == SCROLL_LEFT) ? 1 : -1;
+			for (int seg=(scroll == SCROLL_LEFT) ? first : last; seg!=in; seg+=step) {
+				*ssd1306_fb_seg(dev, page, seg) = *ssd1306_fb_seg(dev, page, seg + step);
+			}
+			*ssd1306_fb_seg(dev, page, in) = column[page - start];
+			continue;
+		}
+		uint8_t * segs = ssd1306_fb(dev, page);
+		if (scroll == SCROLL_LEFT) {
+			memmove(&segs[first], &segs[first + 1], last - first);
+		} else {
+			memmove(&segs[first + 1], &segs[first], last - first);
+		}
+		segs[in] = column[page - start];
+	}
+
+	if (!dev->_hwContentScroll || pending || dev->_pageFlip) {
+		ssd1306_flush_rect(dev, first, start * 8, last - first + 1, (end - start + 1) * 8);
+		return ESP_OK;
+	}
+	uint8_t cmds[7];
+	cmds[0] = (scroll == SCROLL_LEFT) ? OLED_CMD_CONTENT_LEFT : OLED_CMD_CONTENT_RIGHT;
+	cmds[1] = 0x00; // Dummy byte
+	cmds[2] = start;
+	cmds[3] = 0x01; // Dummy byte
+	cmds[4] = end;
+	cmds[5] = first + CONFIG_OFFSETX;
+	cmds[6] = last + CONFIG_OFFSETX;
+	dev->_ops->write_cmds(dev, cmds, 7);
+	ssd1306_write_fb(dev, dev->_fb, start, end - start + 1, in, 1, false);
+	return ESP_OK;
 }
 
 // delay = 0 : display with no wait
@@ -267,18 +1258,39 @@ void ssd1306_hardware_scroll(SSD1306_t * dev, ssd1306_scroll_type_t scroll)
 // delay < 0 : no display
 void ssd1306_wrap_arround(SSD1306_t * dev, ssd1306_scroll_type_t scroll, int start, int end, int8_t delay)
 {
-	if (scroll == SCROLL_RIGHT) {
+	if (dev->_fbColumns && (scroll == SCROLL_RIGHT || scroll == SCROLL_LEFT)) {
+		int _end = end;
+		if (_end >= dev->_pages) _end = dev->_pages - 1;
+		// Segments of a page are _panelPages bytes apart
+		int step = (scroll == SCROLL_LEFT) ? dev->_panelPages : -dev->_panelPages;
+		int from = (scroll == SCROLL_LEFT) ? 0 : dev->_width - 1;
+		for (int page=start;page<=_end;page++) {
+			uint8_t * seg = ssd1306_fb_seg(dev, page, from);
+			uint8_t wk = *seg;
+			for (int n=0;n<dev->_width-1;n++, seg+=step) {
+				seg[0] = seg[step];
+			}
+			*seg = wk;
+		}
+
+	} else if (dev->_fbColumns && (scroll == SCROLL_UP || scroll == SCROLL_DOWN)) {
+		int _end = end;
+		if (_end >= dev->_width) _end = dev->_width - 1;
+		// One word per column
+		ssd1306_shift_columns(dev, start, _end - start + 1, (scroll == SCROLL_UP) ? -1 : 1, true);
+
+	} else if (scroll == SCROLL_RIGHT) {
 		int _start = start; // 0 to 7
 		int _end = end; // 0 to 7
 		if (_end >= dev->_pages) _end = dev->_pages - 1;
 		uint8_t wk;
 		//for (int page=0;page<dev->_pages;page++) {
 		for (int page=_start;page<=_end;page++) {
-			wk = dev->_page[page]._segs[127];
-			for (int seg=127;seg>0;seg--) {
-				dev->_page[page]._segs[seg] = dev->_page[page]._segs[seg-1];
+			wk = ssd1306_fb(dev, page)[dev->_width-1];
+			for (int seg=dev->_width-1;seg>0;seg--) {
+				ssd1306_fb(dev, page)[seg] = ssd1306_fb(dev, page)[seg-1];
 			}
-			dev->_page[page]._segs[0] = wk;
+			ssd1306_fb(dev, page)[0] = wk;
 		}
 
 	} else if (scroll == SCROLL_LEFT) {
@@ -288,261 +1300,99 @@ void ssd1306_wrap_arround(SSD1306_t * dev, ssd1306_scroll_type_t scroll, int sta
 		uint8_t wk;
 		//for (int page=0;page<dev->_pages;page++) {
 		for (int page=_start;page<=_end;page++) {
-			wk = dev->_page[page]._segs[0];
-			for (int seg=0;seg<127;seg++) {
-				dev->_page[page]._segs[seg] = dev->_page[page]._segs[seg+1];
+			wk = ssd1306_fb(dev, page)[0];
+			for (int seg=0;seg<dev->_width-1;seg++) {
+				ssd1306_fb(dev, page)[seg] = ssd1306_fb(dev, page)[seg+1];
 			}
-			dev->_page[page]._segs[127] = wk;
+			ssd1306_fb(dev, page)[dev->_width-1] = wk;
 		}
 
 	} else if (scroll == SCROLL_UP) {
 		int _start = start; // 0 to {width-1}
 		int _end = end; // 0 to {width-1}
 		if (_end >= dev->_width) _end = dev->_width - 1;
-		uint8_t wk0;
-		uint8_t wk1;
-		uint8_t wk2;
-		uint8_t save[128];
-		// Save pages 0
-		for (int seg=0;seg<128;seg++) {
-			save[seg] = dev->_page[0]._segs[seg];
-		}
-		// Page0 to Page6
-		for (int page=0;page<dev->_pages-1;page++) {
-			//for (int seg=0;seg<128;seg++) {
-			for (int seg=_start;seg<=_end;seg++) {
-				wk0 = dev->_page[page]._segs[seg];
-				wk1 = dev->_page[page+1]._segs[seg];
-				if (dev->_flip) wk0 = ssd1306_rotate_byte(wk0);
-				if (dev->_flip) wk1 = ssd1306_rotate_byte(wk1);
-				if (seg == 0) {
-					ESP_LOGD(TAG, "b page=%d wk0=%02x wk1=%02x", page, wk0, wk1);
-				}
-				wk0 = wk0 >> 1;
-				wk1 = wk1 & 0x01;
-				wk1 = wk1 << 7;
-				wk2 = wk0 | wk1;
-				if (seg == 0) {
-					ESP_LOGD(TAG, "a page=%d wk0=%02x wk1=%02x wk2=%02x", page, wk0, wk1, wk2);
-				}
-				if (dev->_flip) wk2 = ssd1306_rotate_byte(wk2);
-				dev->_page[page]._segs[seg] = wk2;
-			}
-		}
-		// Page7
+		// Column by column, the top row comes back in at the bottom
 		int pages = dev->_pages-1;
-		//for (int seg=0;seg<128;seg++) {
 		for (int seg=_start;seg<=_end;seg++) {
-			wk0 = dev->_page[pages]._segs[seg];
-			wk1 = save[seg];
-			if (dev->_flip) wk0 = ssd1306_rotate_byte(wk0);
-			if (dev->_flip) wk1 = ssd1306_rotate_byte(wk1);
-			wk0 = wk0 >> 1;
-			wk1 = wk1 & 0x01;
-			wk1 = wk1 << 7;
-			wk2 = wk0 | wk1;
-			if (dev->_flip) wk2 = ssd1306_rotate_byte(wk2);
-			dev->_page[pages]._segs[seg] = wk2;
+			uint8_t save = ssd1306_fb(dev, 0)[seg];
+			for (int page=0;page<pages;page++) {
+				uint8_t wk0 = ssd1306_fb(dev, page)[seg] >> 1;
+				uint8_t wk1 = (ssd1306_fb(dev, page+1)[seg] & 0x01) << 7;
+				ssd1306_fb(dev, page)[seg] = wk0 | wk1;
+			}
+			ssd1306_fb(dev, pages)[seg] = (ssd1306_fb(dev, pages)[seg] >> 1) | ((save & 0x01) << 7);
 		}
 
 	} else if (scroll == SCROLL_DOWN) {
 		int _start = start; // 0 to {width-1}
 		int _end = end; // 0 to {width-1}
 		if (_end >= dev->_width) _end = dev->_width - 1;
-		uint8_t wk0;
-		uint8_t wk1;
-		uint8_t wk2;
-		uint8_t save[128];
-		// Save pages 7
+		// Column by column, the bottom row comes back in at the top
 		int pages = dev->_pages-1;
-		for (int seg=0;seg<128;seg++) {
-			save[seg] = dev->_page[pages]._segs[seg];
-		}
-		// Page7 to Page1
-		for (int page=pages;page>0;page--) {
-			//for (int seg=0;seg<128;seg++) {
-			for (int seg=_start;seg<=_end;seg++) {
-				wk0 = dev->_page[page]._segs[seg];
-				wk1 = dev->_page[page-1]._segs[seg];
-				if (dev->_flip) wk0 = ssd1306_rotate_byte(wk0);
-				if (dev->_flip) wk1 = ssd1306_rotate_byte(wk1);
-				if (seg == 0) {
-					ESP_LOGD(TAG, "b page=%d wk0=%02x wk1=%02x", page, wk0, wk1);
-				}
-				wk0 = wk0 << 1;
-				wk1 = wk1 & 0x80;
-				wk1 = wk1 >> 7;
-				wk2 = wk0 | wk1;
-				if (seg == 0) {
-					ESP_LOGD(TAG, "a page=%d wk0=%02x wk1=%02x wk2=%02x", page, wk0, wk1, wk2);
-				}
-				if (dev->_flip) wk2 = ssd1306_rotate_byte(wk2);
-				dev->_page[page]._segs[seg] = wk2;
-			}
-		}
-		// Page0
-		//for (int seg=0;seg<128;seg++) {
 		for (int seg=_start;seg<=_end;seg++) {
-			wk0 = dev->_page[0]._segs[seg];
-			wk1 = save[seg];
-			if (dev->_flip) wk0 = ssd1306_rotate_byte(wk0);
-			if (dev->_flip) wk1 = ssd1306_rotate_byte(wk1);
-			wk0 = wk0 << 1;
-			wk1 = wk1 & 0x80;
-			wk1 = wk1 >> 7;
-			wk2 = wk0 | wk1;
-			if (dev->_flip) wk2 = ssd1306_rotate_byte(wk2);
-			dev->_page[0]._segs[seg] = wk2;
+			uint8_t save = ssd1306_fb(dev, pages)[seg];
+			for (int page=pages;page>0;page--) {
+				uint8_t wk0 = ssd1306_fb(dev, page)[seg] << 1;
+				uint8_t wk1 = (ssd1306_fb(dev, page-1)[seg] & 0x80) >> 7;
+				ssd1306_fb(dev, page)[seg] = wk0 | wk1;
+			}
+			ssd1306_fb(dev, 0)[seg] = (ssd1306_fb(dev, 0)[seg] << 1) | ((save & 0x80) >> 7);
 		}
 
 	}
 
-	if (delay >= 0) {
+	if (delay >= 0 && dev->_fbColumns) {
+		// Whole columns, one transfer
+		ssd1306_flush_rect(dev, 0, 0, dev->_width, dev->_height);
+		if (delay) vTaskDelay(delay);
+	} else if (delay >= 0) {
 		for (int page=0;page<dev->_pages;page++) {
-			if (dev->_address == SPIAddress) {
-				spi_display_image(dev, page, 0, dev->_page[page]._segs, 128);
-			} else {
-				i2c_display_image(dev, page, 0, dev->_page[page]._segs, 128);
-			}
+			ssd1306_flush_rect(dev, 0, page * 8, dev->_width, 8);
 			if (delay) vTaskDelay(delay);
 		}
+	} else if (scroll == SCROLL_RIGHT || scroll == SCROLL_LEFT) {
+		for (int page=start;page<=end && page<dev->_pages;page++) {
+			ssd1306_mark_dirty(dev, page, 0, dev->_width);
+		}
+	} else if (scroll == SCROLL_UP || scroll == SCROLL_DOWN) {
+		for (int page=0;page<dev->_pages;page++) {
+			ssd1306_mark_dirty(dev, page, start, end - start + 1);
+		}
 	}
 
 }
 
+// Row-major bitmap, see IMAGE_ROW_MAJOR, copied into the buffer and flushed
 void ssd1306_bitmaps(SSD1306_t * dev, int xpos, int ypos, uint8_t * bitmap, int width, int height, bool invert)
 {
-	if ( (width % 8) != 0) {
-		ESP_LOGE(TAG, "width must be a multiple of 8");
-		return;
-	}
-	int _width = width / 8;
-	uint8_t wk0;
-	uint8_t wk1;
-	uint8_t wk2;
-	uint8_t page = (ypos / 8);
-	uint8_t _seg = xpos;
-	uint8_t dstBits = (ypos % 8);
-	ESP_LOGD(TAG, "ypos=%d page=%d dstBits=%d", ypos, page, dstBits);
-	int offset = 0;
-	for(int _height=0;_height<height;_height++) {
-		for (int index=0;index<_width;index++) {
-			for (int srcBits=7; srcBits>=0; srcBits--) {
-				wk0 = dev->_page[page]._segs[_seg];
-				if (dev->_flip) wk0 = ssd1306_rotate_byte(wk0);
-
-				wk1 = bitmap[index+offset];
-				if (invert) wk1 = ~wk1;
-
-				//wk2 = ssd1306_copy_bit(bitmap[index+offset], srcBits, wk0, dstBits);
-				wk2 = ssd1306_copy_bit(wk1, srcBits, wk0, dstBits);
-				if (dev->_flip) wk2 = ssd1306_rotate_byte(wk2);
-
-				ESP_LOGD(TAG, "index=%d offset=%d page=%d _seg=%d, wk2=%02x", index, offset, page, _seg, wk2);
-				dev->_page[page]._segs[_seg] = wk2;
-				_seg++;
-			}
-		}
-		vTaskDelay(1);
-		offset = offset + _width;
-		dstBits++;
-		_seg = xpos;
-		if (dstBits == 8) {
-			page++;
-			dstBits=0;
-		}
-	}
-
-#if 0
-	for (int _seg=ypos;_seg<ypos+width;_seg++) {
-		ssd1306_dump_page(dev, page-1, _seg);
-	}
-	for (int _seg=ypos;_seg<ypos+width;_seg++) {
-		ssd1306_dump_page(dev, page, _seg);
-	}
-#endif
-	ssd1306_show_buffer(dev);
+	ssd1306_image_t image = {
+		.data = bitmap,
+		.mask = NULL,
+		.width = width,
+		.height = height,
+		.format = IMAGE_ROW_MAJOR,
+	};
+	ssd1306_blit(dev, xpos, ypos, &image, BLIT_COPY, invert);
+	ssd1306_flush(dev);
 }
 
 
 // Set pixel to internal buffer. Not show it.
 void _ssd1306_pixel(SSD1306_t * dev, int xpos, int ypos, bool invert)
 {
+	if (xpos < 0 || ypos < 0 || xpos >= dev->_width || ypos >= dev->_height) return;
 	uint8_t _page = (ypos / 8);
 	uint8_t _bits = (ypos % 8);
 	uint8_t _seg = xpos;
-	uint8_t wk0 = dev->_page[_page]._segs[_seg];
+	uint8_t wk0 = *ssd1306_fb_seg(dev, _page, _seg);
 	uint8_t wk1 = 1 << _bits;
-	ESP_LOGD(TAG, "ypos=%d _page=%d _bits=%d wk0=0x%02x wk1=0x%02x", ypos, _page, _bits, wk0, wk1);
 	if (invert) {
 		wk0 = wk0 & ~wk1;
 	} else {
 		wk0 = wk0 | wk1;
 	}
-	if (dev->_flip) wk0 = ssd1306_rotate_byte(wk0);
-	ESP_LOGD(TAG, "wk0=0x%02x wk1=0x%02x", wk0, wk1);
-	dev->_page[_page]._segs[_seg] = wk0;
-}
-
-// Set line to internal buffer. Not show it.
-void _ssd1306_line(SSD1306_t * dev, int x1, int y1, int x2, int y2,  bool invert)
-{
-	int i;
-	int dx,dy;
-	int sx,sy;
-	int E;
-
-	/* distance between two points */
-	dx = ( x2 > x1 ) ? x2 - x1 : x1 - x2;
-	dy = ( y2 > y1 ) ? y2 - y1 : y1 - y2;
-
-	/* direction of two point */
-	sx = ( x2 > x1 ) ? 1 : -1;
-	sy = ( y2 > y1 ) ? 1 : -1;
-
-	/* inclination < 1 */
-	if ( dx > dy ) {
-		E = -dx;
-		for ( i = 0 ; i <= dx ; i++ ) {
-			_ssd1306_pixel(dev, x1, y1, invert);
-			x1 += sx;
-			E += 2 * dy;
-			if ( E >= 0 ) {
-			y1 += sy;
-			E -= 2 * dx;
-		}
-	}
-
-	/* inclination >= 1 */
-	} else {
-		E = -dy;
-		for ( i = 0 ; i <= dy ; i++ ) {
-			_ssd1306_pixel(dev, x1, y1, invert);
-			y1 += sy;
-			E += 2 * dx;
-			if ( E >= 0 ) {
-				x1 += sx;
-				E -= 2 * dy;
-			}
-		}
-	}
-}
-
-void ssd1306_invert(uint8_t *buf, size_t blen)
-{
-	uint8_t wk;
-	for(int i=0; i<blen; i++){
-		wk = buf[i];
-		buf[i] = ~wk;
-	}
-}
-
-// Flip upside down
-void ssd1306_flip(uint8_t *buf, size_t blen)
-{
-	for(int i=0; i<blen; i++){
-		buf[i] = ssd1306_rotate_byte(buf[i]);
-	}
+	*ssd1306_fb_seg(dev, _page, _seg) = wk0;
+	ssd1306_mark_dirty(dev, _page, _seg, 1);
 }
 
 uint8_t ssd1306_copy_bit(uint8_t src, int srcBits, uint8_t dst, int dstBits)
@@ -566,44 +1416,32 @@ uint8_t ssd1306_copy_bit(uint8_t src, int srcBits, uint8_t dst, int dstBits)
 }
 
 
+static const uint8_t rotate_byte_table[256] = {
+	0x00, 0x80, 0x40, 0xC0, 0x20, 0xA0, 0x60, 0xE0, 0x10, 0x90, 0x50, 0xD0, 0x30, 0xB0, 0x70, 0xF0,
+	0x08, 0x88, 0x48, 0xC8, 0x28, 0xA8, 0x68, 0xE8, 0x18, 0x98, 0x58, 0xD8, 0x38, 0xB8, 0x78, 0xF8,
+	0x04, 0x84, 0x44, 0xC4, 0x24, 0xA4, 0x64, 0xE4, 0x14, 0x94, 0x54, 0xD4, 0x34, 0xB4, 0x74, 0xF4,
+	0x0C, 0x8C, 0x4C, 0xCC, 0x2C, 0xAC, 0x6C, 0xEC, 0x1C, 0x9C, 0x5C, 0xDC, 0x3C, 0xBC, 0x7C, 0xFC,
+	0x02, 0x82, 0x42, 0xC2, 0x22, 0xA2, 0x62, 0xE2, 0x12, 0x92, 0x52, 0xD2, 0x32, 0xB2, 0x72, 0xF2,
+	0x0A, 0x8A, 0x4A, 0xCA, 0x2A, 0xAA, 0x6A, 0xEA, 0x1A, 0x9A, 0x5A, 0xDA, 0x3A, 0xBA, 0x7A, 0xFA,
+	0x06, 0x86, 0x46, 0xC6, 0x26, 0xA6, 0x66, 0xE6, 0x16, 0x96, 0x56, 0xD6, 0x36, 0xB6, 0x76, 0xF6,
+	0x0E, 0x8E, 0x4E, 0xCE, 0x2E, 0xAE, 0x6E, 0xEE, 0x1E, 0x9E, 0x5E, 0xDE, 0x3E, 0xBE, 0x7E, 0xFE,
+	0x01, 0x81, 0x41, 0xC1, 0x21, 0xA1, 0x61, 0xE1, 0x11, 0x91, 0x51, 0xD1, 0x31, 0xB1, 0x71, 0xF1,
+	0x09, 0x89, 0x49, 0xC9, 0x29, 0xA9, 0x69, 0xE9, 0x19, 0x99, 0x59, 0xD9, 0x39, 0xB9, 0x79, 0xF9,
+	0x05, 0x85, 0x45, 0xC5, 0x25, 0xA5, 0x65, 0xE5, 0x15, 0x95, 0x55, 0xD5, 0x35, 0xB5, 0x75, 0xF5,
+	0x0D, 0x8D, 0x4D, 0xCD, 0x2D, 0xAD, 0x6D, 0xED, 0x1D, 0x9D, 0x5D, 0xDD, 0x3D, 0xBD, 0x7D, 0xFD,
+	0x03, 0x83, 0x43, 0xC3, 0x23, 0xA3, 0x63, 0xE3, 0x13, 0x93, 0x53, 0xD3, 0x33, 0xB3, 0x73, 0xF3,
+	0x0B, 0x8B, 0x4B, 0xCB, 0x2B, 0xAB, 0x6B, 0xEB, 0x1B, 0x9B, 0x5B, 0xDB, 0x3B, 0xBB, 0x7B, 0xFB,
+	0x07, 0x87, 0x47, 0xC7, 0x27, 0xA7, 0x67, 0xE7, 0x17, 0x97, 0x57, 0xD7, 0x37, 0xB7, 0x77, 0xF7,
+	0x0F, 0x8F, 0x4F, 0xCF, 0x2F, 0xAF, 0x6F, 0xEF, 0x1F, 0x9F, 0x5F, 0xDF, 0x3F, 0xBF, 0x7F, 0xFF,
+};
+
 // Rotate 8-bit data
 // 0x12-->0x48
 uint8_t ssd1306_rotate_byte(uint8_t ch1) {
-	uint8_t ch2 = 0;
-	for (int j=0;j<8;j++) {
-		ch2 = (ch2 << 1) + (ch1 & 0x01);
-		ch1 = ch1 >> 1;
-	}
-	return ch2;
+	return rotate_byte_table[ch1];
 }
 
 
-void ssd1306_fadeout(SSD1306_t * dev)
-{
-	void (*func)(SSD1306_t * dev, int page, int seg, uint8_t * images, int width);
-	if (dev->_address == SPIAddress) {
-		func = spi_display_image;
-	} else {
-		func = i2c_display_image;
-	}
-
-	uint8_t image[1];
-	for(int page=0; page<dev->_pages; page++) {
-		image[0] = 0xFF;
-		for(int line=0; line<8; line++) {
-			if (dev->_flip) {
-				image[0] = image[0] >> 1;
-			} else {
-				image[0] = image[0] << 1;
-			}
-			for(int seg=0; seg<128; seg++) {
-				(*func)(dev, page, seg, image, 1);
-				dev->_page[page]._segs[seg] = image[0];
-			}
-		}
-	}
-}
-
 void ssd1306_dump(SSD1306_t dev)
 {
 	printf("_address=%x\n",dev._address);
@@ -614,6 +1452,6 @@ void ssd1306_dump(SSD1306_t dev)
 
 void ssd1306_dump_page(SSD1306_t * dev, int page, int seg)
 {
-	ESP_LOGI(TAG, "dev->_page[%d]._segs[%d]=%02x", page, seg, dev->_page[page]._segs[seg]);
+	ESP_LOGI(TAG, "dev->_page[%d]._segs[%d]=%02x", page, seg, *ssd1306_fb_seg(dev, page, seg));
 }
 
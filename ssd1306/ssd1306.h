@@ -1,7 +1,17 @@
 #ifndef MAIN_SSD1306_H_
 #define MAIN_SSD1306_H_
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
+#include "esp_err.h"
+#if !CONFIG_IDF_TARGET_LINUX
 #include "driver/spi_master.h"
+#if CONFIG_SSD1306_I2C_ASYNC
+#include "driver/i2c_master.h"
+#endif
+#endif
 
 // Following definitions are bollowed from 
 // http://robotcantalk.blogspot.com/2015/03/interfacing-arduino-with-ssd1306-driven.html
@@ -47,6 +57,7 @@ Usage:
 #define OLED_CMD_SET_SEGMENT_REMAP_0    0xA0    
 #define OLED_CMD_SET_SEGMENT_REMAP_1    0xA1    
 #define OLED_CMD_SET_MUX_RATIO          0xA8    // follow with 0x3F = 64 MUX
+#define OLED_CMD_SET_COM_SCAN_MODE_0    0xC0
 #define OLED_CMD_SET_COM_SCAN_MODE      0xC8    
 #define OLED_CMD_SET_DISPLAY_OFFSET     0xD3    // follow with 0x00
 #define OLED_CMD_SET_COM_PIN_MAP        0xDA    // follow with 0x12
@@ -64,13 +75,32 @@ Usage:
 #define OLED_CMD_HORIZONTAL_RIGHT       0x26
 #define OLED_CMD_HORIZONTAL_LEFT        0x27
 #define OLED_CMD_CONTINUOUS_SCROLL      0x29
+#define OLED_CMD_CONTENT_RIGHT          0x2C    // one column, follow with 0x00, start page, 0x01, end page, start and end column
+#define OLED_CMD_CONTENT_LEFT           0x2D
 #define OLED_CMD_DEACTIVE_SCROLL        0x2E
 #define OLED_CMD_ACTIVE_SCROLL          0x2F
 #define OLED_CMD_VERTICAL               0xA3
 
+// Advanced Graphic Commands, not implemented by every SSD1306 clone
+#define OLED_CMD_SET_FADE_BLINK         0x23    // follow with 0x20|interval (fade out) or 0x30|interval (blink)
+#define OLED_CMD_SET_ZOOM               0xD6    // follow with 0x01 = zoom in
+
 #define I2CAddress 0x3C
 #define SPIAddress 0xFF
 
+// SPI transactions kept in flight, enough for a command plus every page of a frame
+#define SSD1306_SPI_QUEUE_SIZE 10
+// Bytes copied into each SPI slot for commands and short images
+#define SSD1306_SPI_SLOT_SIZE 32
+
+// I2C transactions kept in flight by the asynchronous transport (CONFIG_SSD1306_I2C_ASYNC)
+#define SSD1306_I2C_QUEUE_SIZE 10
+// Control and positioning bytes of one I2C transaction, plus short images copied behind them
+#define SSD1306_I2C_SLOT_SIZE 48
+// Rows of a window the blocking I2C transport puts in one transaction when they are not
+// contiguous, a column layout window narrower than the panel takes one transaction per this many
+#define SSD1306_I2C_LINK_ROWS 8
+
 typedef enum {
 	SCROLL_RIGHT = 1,
 	SCROLL_LEFT = 2,
@@ -79,37 +109,292 @@ typedef enum {
 	SCROLL_STOP = 5
 } ssd1306_scroll_type_t;
 
+typedef enum {
+	ROTATE_0 = 0,
+	ROTATE_90 = 1,	// Portrait, panel turned clockwise
+	ROTATE_180 = 2,
+	ROTATE_270 = 3	// Portrait, panel turned counterclockwise
+} ssd1306_rotation_t;
+
+typedef enum {
+	LAYOUT_PAGES = 0,	// One page after the other, as GDDRAM is written in page addressing
+	LAYOUT_COLUMNS = 1	// One column after the other, a 64 (or 32) bit word per column
+} ssd1306_layout_t;
+
+// Dirty span of one page of the framebuffer
 typedef struct {
-	bool _valid; // Not using it anymore
-	int _segLen; // Not using it anymore
-	uint8_t _segs[128];
+	int16_t _dirtyStart; // First segment changed since last transfer
+	int16_t _dirtyEnd; // Last segment changed since last transfer (< _dirtyStart when clean)
 } PAGE_t;
 
+typedef enum {
+	TEXT_ALIGN_LEFT = 0,
+	TEXT_ALIGN_CENTER = 1,
+	TEXT_ALIGN_RIGHT = 2
+} ssd1306_text_align_t;
+
+// Glyph columns are stored in GDDRAM bit order (LSB on top), one font page after the
+// other: a 12x16 glyph is the 12 bytes of its upper page followed by the 12 of the lower one.
 typedef struct {
+	const uint8_t * bitmap;
+	const uint16_t * offsets; // Start of each glyph in bitmap, NULL when every glyph is width wide
+	const uint8_t * widths; // Width of each glyph, NULL when every glyph is width wide
+	uint8_t first; // First character in the font
+	uint8_t last; // Last character in the font
+	uint8_t width; // Glyph width of a fixed font, width of missing characters
+	uint8_t height; // Multiple of 8
+	uint8_t spacing; // Blank columns after each glyph
+} ssd1306_font_t;
+
+extern const ssd1306_font_t ssd1306_font_8x8;
+extern const ssd1306_font_t ssd1306_font_8x8_prop;
+
+typedef enum {
+	IMAGE_PAGE_MAJOR = 0,	// GDDRAM layout: one byte is 8 rows of a column (LSB on top), width bytes per 8 rows
+	IMAGE_ROW_MAJOR = 1	// One bit per pixel, MSB left, every row padded to whole bytes (what ssd1306_bitmaps() takes)
+} ssd1306_image_format_t;
+
+typedef struct {
+	const uint8_t * data;
+	const uint8_t * mask; // Same layout as data, only pixels set here are drawn. NULL draws every pixel.
+	int width;
+	int height;
+	ssd1306_image_format_t format;
+} ssd1306_image_t;
+
+typedef enum {
+	BLIT_COPY = 0,	// Image replaces the buffer
+	BLIT_OR = 1,	// Set pixels of the image are set
+	BLIT_AND = 2,	// Clear pixels of the image are cleared
+	BLIT_XOR = 3	// Set pixels of the image are toggled
+} ssd1306_blit_op_t;
+
+typedef struct {
+	int x;
+	int y;
+} ssd1306_point_t;
+
+typedef struct SSD1306_s SSD1306_t;
+typedef struct ssd1306_scheduler_s ssd1306_scheduler_t;
+
+typedef enum {
+	FADE_NONE = 0,
+	FADE_OUT = 1,	// Contrast down to 0, then display off
+	FADE_IN = 2,	// Display on, contrast up from 0
+	FADE_BLINK = 3,	// Contrast down and up again
+	FADE_WIPE = 4	// Pages wiped line by line, what ssd1306_fadeout() shows
+} ssd1306_fade_type_t;
+
+// Called from the FreeRTOS timer task when a fade has finished
+typedef void (*ssd1306_fade_cb_t)(SSD1306_t * dev, void * arg);
+
+// Called with the result of every I2C transfer. The asynchronous transport calls it
+// from its interrupt handler, keep it short and use the FromISR FreeRTOS functions.
+typedef void (*ssd1306_transfer_cb_t)(SSD1306_t * dev, esp_err_t result, void * arg);
+
+// Bus transport. Every transfer of the driver goes through one of these.
+typedef struct {
+	// Prepare the transport before the init sequence is sent, may be NULL
+	void (*init)(SSD1306_t * dev);
+	// Command bytes, one command stream
+	void (*write_cmds)(SSD1306_t * dev, const uint8_t * cmds, int len);
+	// GDDRAM data at the current address
+	void (*write_data)(SSD1306_t * dev, const uint8_t * data, int len);
+	// Positioning commands followed by rows x width bytes of data, row n read from data + n * stride.
+	// data may be reused when it returns.
+	void (*write_window)(SSD1306_t * dev, const uint8_t * cmds, int len, const uint8_t * data, int stride, int rows, int width);
+	// Same as write_window but may return before the transfer is done,
+	// data must stay untouched until wait(). NULL falls back to write_window.
+	void (*flush_async)(SSD1306_t * dev, const uint8_t * cmds, int len, const uint8_t * data, int stride, int rows, int width);
+	// Block until every transfer left the bus, may be NULL
+	void (*wait)(SSD1306_t * dev);
+	// Change the bus clock, waits for queued transfers first. NULL when the clock is fixed.
+	esp_err_t (*set_clock)(SSD1306_t * dev, int hz);
+} ssd1306_bus_ops_t;
+
+struct SSD1306_s {
 	int _address;
-	int _width;
+	int _i2cPort;
+	int _width; // Drawing width, the panel height in portrait mode
 	int _height;
 	int _pages;
+	int _panelWidth; // Physical size, what goes over the bus
+	int _panelPages;
 	int _dc;
+	uintptr_t _initKey; // SSD1306_INIT_KEY(dev) once a transport set the panel up, see ssd1306_release()
+	const ssd1306_bus_ops_t * _ops;
+	void * _busCtx; // Transport private data
+	int _clockHz; // Bus clock currently set
+	int _busErrors; // Failed or timed out transfers, counted by the transport
+	ssd1306_transfer_cb_t _transferDone;
+	void * _transferArg;
+#if !CONFIG_IDF_TARGET_LINUX
 	spi_device_handle_t _SPIHandle;
+	int _spiHost;
+	int _spiCs;
+#endif
 	bool _scEnable;
 	int _scStart;
 	int _scEnd;
 	int _scDirection;
+	int _startLine; // Display start line, see ssd1306_vscroll()
+	bool _pageFlip; // 128x32 panel drawing into the hidden half of GDDRAM, see ssd1306_page_flip()
+	int _pageBase; // GDDRAM page shown at the top, 0 or 4 with page flipping
+	PAGE_t _flipPage[4]; // Changes of the last frame the hidden half does not have yet
+	uint8_t * _fb; // _panelPages x _panelWidth bytes, one page after the other
+	bool _fbColumns; // _fb holds one column after the other, see ssd1306_set_layout()
+	size_t _fbSize;
+	bool _fbOwned; // Allocated by ssd1306_init()
+	uint32_t _fbCaps; // Heap capabilities the transport needs to send _fb without a copy
 	PAGE_t _page[8];
-	bool _flip;
-} SSD1306_t;
+	bool _flip; // Set before ssd1306_init() or through ssd1306_set_flip()
+	int _addrMode; // Memory addressing mode currently set in the controller
+#if !CONFIG_IDF_TARGET_LINUX
+	spi_transaction_t _spiTrans[SSD1306_SPI_QUEUE_SIZE]; // Owned by the SPI driver while queued
+	uint8_t _spiSlot[SSD1306_SPI_QUEUE_SIZE][SSD1306_SPI_SLOT_SIZE];
+	int _spiNext;
+	int _spiPending;
+#endif
+#if !CONFIG_IDF_TARGET_LINUX && CONFIG_SSD1306_I2C_ASYNC
+	i2c_master_dev_handle_t _i2cDev;
+	SemaphoreHandle_t _i2cFree; // One count per slot the driver gave back
+	StaticSemaphore_t _i2cFreeBuffer;
+	uint8_t _i2cSlot[SSD1306_I2C_QUEUE_SIZE][SSD1306_I2C_SLOT_SIZE]; // Owned by the I2C driver while queued
+	int _i2cNext;
+#endif
+	uint8_t * _front; // Double buffer: copy of _fb being sent by the flush task
+	PAGE_t _frontPage[8];
+	TaskHandle_t _flushTask;
+	SemaphoreHandle_t _frontFree;
+	volatile bool _flushStop;
+	volatile bool _frontPending; // Front buffer holds changes the flush task has not sent
+	ssd1306_scheduler_t * _sched;
+	int _contrast; // Last value given to ssd1306_contrast()
+	bool _hwFade; // Panel implements fade/blink (23) and zoom (D6)
+	bool _hwContentScroll; // Panel implements the one column content scroll (2C/2D)
+	TimerHandle_t _fadeTimer;
+	ssd1306_fade_type_t _fadeType;
+	int _fadeStep;
+	int _fadeSteps; // 0 runs until ssd1306_fade_stop()
+	int _fadeCycle; // Steps per blink
+	ssd1306_fade_cb_t _fadeDone;
+	void * _fadeArg;
+	const ssd1306_font_t * _font;
+	int _fontScale;
+	ssd1306_rotation_t _rotation;
+	uint8_t * _canvas; // Portrait mode or virtual canvas: _pages x _width bytes drawn instead of _fb
+	bool _virtual; // _canvas is larger than the panel, which shows it through a viewport
+	int _viewX; // Virtual canvas column at the left edge of the panel
+	int _viewY; // Virtual canvas row at the top of the panel
+};
+
+// Page of the buffer every drawing function writes to, _width bytes.
+// Not with the column layout, ssd1306_fb_seg() works with both.
+static inline uint8_t * ssd1306_fb(SSD1306_t * dev, int page)
+{
+	if (dev->_canvas) return &dev->_canvas[page * dev->_width];
+	return &dev->_fb[page * dev->_panelWidth];
+}
+
+// Byte of the buffer holding segment seg of page
+static inline uint8_t * ssd1306_fb_seg(SSD1306_t * dev, int page, int seg)
+{
+	if (dev->_canvas) return &dev->_canvas[page * dev->_width + seg];
+	if (dev->_fbColumns) return &dev->_fb[seg * dev->_panelPages + page];
+	return &dev->_fb[page * dev->_panelWidth + seg];
+}
 
+// Transpose an 8x8 bit matrix held one row per byte: bit i of byte j becomes bit j of byte i
+static inline uint64_t ssd1306_transpose8(uint64_t x)
+{
+	uint64_t t;
+	t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+	x = x ^ t ^ (t << 7);
+	t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+	x = x ^ t ^ (t << 14);
+	t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+	x = x ^ t ^ (t << 28);
+	return x;
+}
+
+// Tells a panel a transport set up before from a new struct, which may hold anything
+#define SSD1306_INIT_KEY(dev) ((uintptr_t)(dev) ^ 0x5D1306A5)
+
+// Panels sharing one flush task, see ssd1306_scheduler_start()
+#define SSD1306_SCHEDULER_SIZE 4
+
+struct ssd1306_scheduler_s {
+	SSD1306_t * devs[SSD1306_SCHEDULER_SIZE];
+	volatile int count;
+	TaskHandle_t task;
+	SemaphoreHandle_t done;
+	volatile bool stop;
+};
+
+// Outcome of ssd1306_calibrate_clock()
+typedef struct {
+	int clockHz; // Highest clock without bus errors, 0 when none was clean
+	int frameUs; // Time to send one full frame at that clock
+	int fps;
+} ssd1306_calibration_t;
+
+// In-memory transport counting what would go over the bus
+typedef struct {
+	int cmdTransactions;
+	int cmdBytes;
+	int dataTransactions;
+	int dataBytes;
+	// The same traffic framed the way the I2C and SPI transports would send it
+	int i2cTransactions;
+	int i2cBytes; // Address and control bytes included
+	int spiTransactions;
+	int spiBytes;
+	// Transfers at a clock above this fail as bus errors, 0 for no limit
+	int maxClockHz;
+	// Called for every transfer when set, data tells command bytes from GDDRAM data
+	void (*onWrite)(void * arg, bool data, const uint8_t * bytes, int len);
+	void * arg;
+} ssd1306_mock_t;
+
+bool ssd1306_release(SSD1306_t * dev);
+esp_err_t ssd1306_set_framebuffer(SSD1306_t * dev, uint8_t * buffer, size_t size);
 void ssd1306_init(SSD1306_t * dev, int width, int height);
+void ssd1306_set_flip(SSD1306_t * dev, bool flip);
+esp_err_t ssd1306_set_rotation(SSD1306_t * dev, ssd1306_rotation_t rotation);
+ssd1306_rotation_t ssd1306_get_rotation(SSD1306_t * dev);
+esp_err_t ssd1306_set_layout(SSD1306_t * dev, ssd1306_layout_t layout);
+uint64_t ssd1306_get_column(SSD1306_t * dev, int x);
+esp_err_t ssd1306_set_column(SSD1306_t * dev, int x, uint64_t rows);
+esp_err_t ssd1306_fill_columns(SSD1306_t * dev, int x, int width, uint64_t rows, bool invert);
+esp_err_t ssd1306_shift_columns(SSD1306_t * dev, int x, int width, int lines, bool rotate);
 int ssd1306_get_width(SSD1306_t * dev);
 int ssd1306_get_height(SSD1306_t * dev);
 int ssd1306_get_pages(SSD1306_t * dev);
 void ssd1306_show_buffer(SSD1306_t * dev);
+void ssd1306_wait(SSD1306_t * dev);
+esp_err_t ssd1306_double_buffer_start(SSD1306_t * dev, UBaseType_t priority, BaseType_t core);
+void ssd1306_double_buffer_stop(SSD1306_t * dev);
+bool ssd1306_present(SSD1306_t * dev, TickType_t wait);
+esp_err_t ssd1306_scheduler_start(ssd1306_scheduler_t * sched, UBaseType_t priority, BaseType_t core);
+esp_err_t ssd1306_scheduler_add(ssd1306_scheduler_t * sched, SSD1306_t * dev);
+void ssd1306_scheduler_stop(ssd1306_scheduler_t * sched);
+void ssd1306_flush(SSD1306_t * dev);
+esp_err_t ssd1306_set_clock(SSD1306_t * dev, int hz);
+void ssd1306_set_transfer_callback(SSD1306_t * dev, ssd1306_transfer_cb_t done, void * arg);
+int ssd1306_get_clock(SSD1306_t * dev);
+esp_err_t ssd1306_calibrate_clock(SSD1306_t * dev, int start_hz, int max_hz, int step_hz, int frames, ssd1306_calibration_t * result);
+void ssd1306_mark_dirty(SSD1306_t * dev, int page, int seg, int width);
+void ssd1306_flush_rect(SSD1306_t * dev, int x, int y, int width, int height);
 void ssd1306_set_buffer(SSD1306_t * dev, uint8_t * buffer);
 void ssd1306_get_buffer(SSD1306_t * dev, uint8_t * buffer);
 void ssd1306_display_image(SSD1306_t * dev, int page, int seg, uint8_t * images, int width);
 void ssd1306_display_text(SSD1306_t * dev, int page, char * text, int text_len, bool invert);
 void ssd1306_display_text_x3(SSD1306_t * dev, int page, char * text, int text_len, bool invert);
+void ssd1306_set_font(SSD1306_t * dev, const ssd1306_font_t * font, int scale);
+int ssd1306_text_width(SSD1306_t * dev, const char * text, int text_len);
+int ssd1306_text_height(SSD1306_t * dev);
+int ssd1306_draw_text(SSD1306_t * dev, int x, int y, const char * text, int text_len, bool invert);
+int ssd1306_draw_text_box(SSD1306_t * dev, int x, int y, int width, int height, const char * text, int text_len, ssd1306_text_align_t align, bool invert);
 void ssd1306_clear_screen(SSD1306_t * dev, bool invert);
 void ssd1306_clear_line(SSD1306_t * dev, int page, bool invert);
 void ssd1306_contrast(SSD1306_t * dev, int contrast);
@@ -117,32 +402,67 @@ void ssd1306_software_scroll(SSD1306_t * dev, int start, int end);
 void ssd1306_scroll_text(SSD1306_t * dev, char * text, int text_len, bool invert);
 void ssd1306_scroll_clear(SSD1306_t * dev);
 void ssd1306_hardware_scroll(SSD1306_t * dev, ssd1306_scroll_type_t scroll);
+esp_err_t ssd1306_vscroll(SSD1306_t * dev, int lines);
+esp_err_t ssd1306_ticker_step(SSD1306_t * dev, ssd1306_scroll_type_t scroll, int start, int end, int first, int last, const uint8_t * column);
+int ssd1306_vscroll_y(SSD1306_t * dev, int y);
+esp_err_t ssd1306_page_flip(SSD1306_t * dev, bool enable);
+esp_err_t ssd1306_set_virtual(SSD1306_t * dev, int width, int height);
+esp_err_t ssd1306_set_viewport(SSD1306_t * dev, int x, int y);
+void ssd1306_get_viewport(SSD1306_t * dev, int * x, int * y);
 void ssd1306_wrap_arround(SSD1306_t * dev, ssd1306_scroll_type_t scroll, int start, int end, int8_t delay);
 void ssd1306_bitmaps(SSD1306_t * dev, int xpos, int ypos, uint8_t * bitmap, int width, int height, bool invert);
+void ssd1306_blit(SSD1306_t * dev, int x, int y, const ssd1306_image_t * image, ssd1306_blit_op_t op, bool invert);
 void _ssd1306_pixel(SSD1306_t * dev, int xpos, int ypos, bool invert);
 void _ssd1306_line(SSD1306_t * dev, int x1, int y1, int x2, int y2,  bool invert);
+void ssd1306_draw_hline(SSD1306_t * dev, int x, int y, int width, bool invert);
+void ssd1306_draw_vline(SSD1306_t * dev, int x, int y, int height, bool invert);
+void ssd1306_draw_rect(SSD1306_t * dev, int x, int y, int width, int height, bool invert);
+void ssd1306_fill_rect(SSD1306_t * dev, int x, int y, int width, int height, bool invert);
+void ssd1306_invert_rect(SSD1306_t * dev, int x, int y, int width, int height);
+void ssd1306_draw_round_rect(SSD1306_t * dev, int x, int y, int width, int height, int r, bool invert);
+void ssd1306_fill_round_rect(SSD1306_t * dev, int x, int y, int width, int height, int r, bool invert);
+void ssd1306_draw_circle(SSD1306_t * dev, int cx, int cy, int r, bool invert);
+void ssd1306_fill_circle(SSD1306_t * dev, int cx, int cy, int r, bool invert);
+void ssd1306_draw_triangle(SSD1306_t * dev, int x0, int y0, int x1, int y1, int x2, int y2, bool invert);
+void ssd1306_fill_triangle(SSD1306_t * dev, int x0, int y0, int x1, int y1, int x2, int y2, bool invert);
+void ssd1306_draw_polyline(SSD1306_t * dev, const ssd1306_point_t * points, int count, bool closed, bool invert);
 void ssd1306_invert(uint8_t *buf, size_t blen);
 void ssd1306_flip(uint8_t *buf, size_t blen);
+void ssd1306_fill(uint8_t *buf, size_t blen, uint8_t value, uint8_t mask);
+void ssd1306_invert_mask(uint8_t *buf, size_t blen, uint8_t mask);
+void ssd1306_xor(uint8_t *dst, const uint8_t *src, size_t blen);
+void ssd1306_or(uint8_t *dst, const uint8_t *src, size_t blen);
+void ssd1306_copy_masked(uint8_t *dst, const uint8_t *src, const uint8_t *mask, size_t blen);
+bool ssd1306_diff_span(const uint8_t *a, const uint8_t *b, size_t blen, int *first, int *last);
 uint8_t ssd1306_copy_bit(uint8_t src, int srcBits, uint8_t dst, int dstBits);
 uint8_t ssd1306_rotate_byte(uint8_t ch1);
 void ssd1306_fadeout(SSD1306_t * dev);
+esp_err_t ssd1306_fade_start(SSD1306_t * dev, ssd1306_fade_type_t fade, int duration_ms, ssd1306_fade_cb_t done, void * arg);
+esp_err_t ssd1306_blink_start(SSD1306_t * dev, int period_ms, int count, ssd1306_fade_cb_t done, void * arg);
+void ssd1306_fade_stop(SSD1306_t * dev);
+bool ssd1306_fade_busy(SSD1306_t * dev);
+esp_err_t ssd1306_zoom(SSD1306_t * dev, bool zoom);
 void ssd1306_dump(SSD1306_t dev);
 void ssd1306_dump_page(SSD1306_t * dev, int page, int seg);
 
+#if !CONFIG_IDF_TARGET_LINUX
 void i2c_master_init(SSD1306_t * dev, int16_t sda, int16_t scl, int16_t reset);
-void i2c_init(SSD1306_t * dev, int width, int height);
-void i2c_display_image(SSD1306_t * dev, int page, int seg, uint8_t * images, int width);
-void i2c_contrast(SSD1306_t * dev, int contrast);
-void i2c_hardware_scroll(SSD1306_t * dev, ssd1306_scroll_type_t scroll);
+esp_err_t i2c_master_init_bus(int port, int16_t sda, int16_t scl);
+void i2c_master_init_device(SSD1306_t * dev, int port, int address, int16_t reset);
 
 void spi_master_init(SSD1306_t * dev, int16_t GPIO_MOSI, int16_t GPIO_SCLK, int16_t GPIO_CS, int16_t GPIO_DC, int16_t GPIO_RESET);
+esp_err_t spi_master_init_bus(int host, int16_t GPIO_MOSI, int16_t GPIO_SCLK);
+void spi_master_init_device(SSD1306_t * dev, int host, int16_t GPIO_CS, int16_t GPIO_DC, int16_t GPIO_RESET);
 bool spi_master_write_byte(spi_device_handle_t SPIHandle, const uint8_t* Data, size_t DataLength );
 bool spi_master_write_command(SSD1306_t * dev, uint8_t Command );
+bool spi_master_write_commands(SSD1306_t * dev, const uint8_t* Commands, size_t Length );
 bool spi_master_write_data(SSD1306_t * dev, const uint8_t* Data, size_t DataLength );
-void spi_init(SSD1306_t * dev, int width, int height);
-void spi_display_image(SSD1306_t * dev, int page, int seg, uint8_t * images, int width);
-void spi_contrast(SSD1306_t * dev, int contrast);
-void spi_hardware_scroll(SSD1306_t * dev, ssd1306_scroll_type_t scroll);
+#endif
+
+void mock_master_init(SSD1306_t * dev, ssd1306_mock_t * mock);
+void mock_reset(ssd1306_mock_t * mock);
+uint32_t mock_i2c_time_us(ssd1306_mock_t * mock, int hz);
+uint32_t mock_spi_time_us(ssd1306_mock_t * mock, int hz);
 
 #endif /* MAIN_SSD1306_H_ */
 
@@ -0,0 +1,93 @@
+#include <string.h>
+
+#include "ssd1306.h"
+
+// Images drawn at any pixel position into the internal buffer. Like text nothing
+// is sent, the clipped destination is marked dirty for the next flush.
+// The image is walked in bands of 8 rows. A band is one byte per column, shifted
+// into a 16 bit word that covers the two pages it lands on.
+
+static inline uint8_t blit_op(uint8_t dst, uint8_t src, uint8_t mask, ssd1306_blit_op_t op)
+{
+	switch (op) {
+	case BLIT_OR:
+		return dst | (src & mask);
+	case BLIT_AND:
+		return dst & (src | ~mask);
+	case BLIT_XOR:
+		return dst ^ (src & mask);
+	default:
+		return (dst & ~mask) | (src & mask);
+	}
+}
+
+// One band of one column, page is where its top row lands and shift the row within that page
+static inline void blit_column(SSD1306_t * dev, int seg, int page, int shift, uint8_t bits, uint8_t mask, ssd1306_blit_op_t op)
+{
+	uint16_t val = bits << shift;
+	uint16_t _mask = mask << shift;
+	if (page >= 0 && (_mask & 0xFF)) {
+		uint8_t * dst = ssd1306_fb_seg(dev, page, seg);
+		*dst = blit_op(*dst, val, _mask, op);
+	}
+	page++;
+	if (page < dev->_pages && (_mask >> 8)) {
+		uint8_t * dst = ssd1306_fb_seg(dev, page, seg);
+		*dst = blit_op(*dst, val >> 8, _mask >> 8, op);
+	}
+}
+
+// 8 columns of a row-major band turned into page layout, byte n is column n
+static uint64_t blit_tile(const uint8_t * data, int stride, int height, int band, int byte)
+{
+	uint64_t rows = 0;
+	for (int row=0; row<8 && band * 8 + row < height; row++) {
+		rows |= (uint64_t)data[(band * 8 + row) * stride + byte] << (row * 8);
+	}
+	// The leftmost pixel is bit 7 of a row, so column n comes out as byte 7-n
+	return __builtin_bswap64(ssd1306_transpose8(rows));
+}
+
+// Draw image with its top left corner at x, y. Pixels outside the panel are dropped.
+// invert applies to the image data, not to its mask.
+void ssd1306_blit(SSD1306_t * dev, int x, int y, const ssd1306_image_t * image, ssd1306_blit_op_t op, bool invert)
+{
+	int width = image->width;
+	int height = image->height;
+	int x0 = x < 0 ? 0 : x;
+	int y0 = y < 0 ? 0 : y;
+	int x1 = x + width > dev->_width ? dev->_width : x + width;
+	int y1 = y + height > dev->_height ? dev->_height : y + height;
+	if (x0 >= x1 || y0 >= y1) return;
+	for (int page=y0 / 8; page<=(y1 - 1) / 8; page++) {
+		ssd1306_mark_dirty(dev, page, x0, x1 - x0);
+	}
+
+	int stride = (width + 7) / 8;
+	for (int band=(y0 - y) / 8; band<=(y1 - 1 - y) / 8; band++) {
+		int top = y + band * 8;
+		int page = top >= 0 ? top / 8 : (top - 7) / 8;
+		int shift = top - page * 8;
+		// The last band may be shorter than 8 rows
+		uint8_t rows = height - band * 8 >= 8 ? 0xFF : 0xFF >> (8 - (height - band * 8));
+		if (image->format == IMAGE_PAGE_MAJOR) {
+			const uint8_t * data = &image->data[band * width];
+			const uint8_t * mask = image->mask ? &image->mask[band * width] : NULL;
+			for (int seg=x0; seg<x1; seg++) {
+				uint8_t bits = invert ? ~data[seg - x] : data[seg - x];
+				blit_column(dev, seg, page, shift, bits, mask ? mask[seg - x] & rows : rows, op);
+			}
+			continue;
+		}
+		for (int byte=(x0 - x) / 8; byte<=(x1 - 1 - x) / 8; byte++) {
+			uint64_t bits = blit_tile(image->data, stride, height, band, byte);
+			uint64_t mask = image->mask ? blit_tile(image->mask, stride, height, band, byte) : ~0ULL;
+			if (invert) bits = ~bits;
+			for (int col=0; col<8; col++) {
+				int seg = x + byte * 8 + col;
+				if (seg < x0 || seg >= x1) continue;
+				blit_column(dev, seg, page, shift, bits >> (col * 8), (mask >> (col * 8)) & rows, op);
+			}
+		}
+	}
+}
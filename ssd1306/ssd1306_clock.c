@@ -0,0 +1,79 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "ssd1306.h"
+
+#define TAG "SSD1306"
+
+// Bus clock at runtime. The default comes from CONFIG_SSD1306_I2C_CLOCK or
+// CONFIG_SSD1306_SPI_CLOCK, short wires and a strong pull-up often allow more.
+
+// Change the bus clock of dev. On I2C every panel on the same port follows.
+// Not while the double buffer runs, its task may be in the middle of a transfer.
+esp_err_t ssd1306_set_clock(SSD1306_t * dev, int hz)
+{
+	if (hz <= 0) return ESP_ERR_INVALID_ARG;
+	if (dev->_ops->set_clock == NULL) return ESP_ERR_NOT_SUPPORTED;
+	if (dev->_flushTask) return ESP_ERR_INVALID_STATE;
+	ssd1306_wait(dev);
+	esp_err_t ret = dev->_ops->set_clock(dev, hz);
+	if (ret != ESP_OK) {
+		ESP_LOGE(TAG, "set_clock %dHz failed. code: 0x%.2X", hz, ret);
+	}
+	return ret;
+}
+
+int ssd1306_get_clock(SSD1306_t * dev)
+{
+	return dev->_clockHz;
+}
+
+// Send frames full frames of the current buffer, true when no transfer failed.
+// *elapsed is the time it took in microseconds, a fast SPI frame is well below a tick.
+static bool ssd1306_calibrate_step(SSD1306_t * dev, int frames, int64_t * elapsed)
+{
+	int errors = dev->_busErrors;
+	int64_t start = esp_timer_get_time();
+	for (int frame=0; frame<frames; frame++) {
+		ssd1306_show_buffer(dev);
+		ssd1306_wait(dev);
+		if (dev->_busErrors != errors) break;
+	}
+	*elapsed = esp_timer_get_time() - start;
+	return dev->_busErrors == errors;
+}
+
+// Raise the clock from start_hz by step_hz up to max_hz, sending frames frames at each rate.
+// The first rate with a failed or timed out transfer ends the search and the panel is left
+// at the highest clean rate. The buffer is sent as it is, draw something busy first.
+// A wrong bit on SPI is not reported by the driver, check the panel after calibrating.
+esp_err_t ssd1306_calibrate_clock(SSD1306_t * dev, int start_hz, int max_hz, int step_hz, int frames, ssd1306_calibration_t * result)
+{
+	if (start_hz <= 0 || step_hz <= 0 || max_hz < start_hz || frames <= 0) return ESP_ERR_INVALID_ARG;
+	if (dev->_ops->set_clock == NULL) return ESP_ERR_NOT_SUPPORTED;
+	if (dev->_flushTask) return ESP_ERR_INVALID_STATE;
+
+	int initial = dev->_clockHz;
+	ssd1306_calibration_t best = { 0 };
+	for (int hz=start_hz; hz<=max_hz; hz+=step_hz) {
+		if (ssd1306_set_clock(dev, hz) != ESP_OK) break;
+		int64_t elapsed;
+		bool clean = ssd1306_calibrate_step(dev, frames, &elapsed);
+		int frameUs = elapsed / frames;
+		ESP_LOGI(TAG, "clock %dHz: %s, %dus per frame", hz, clean ? "clean" : "bus errors", frameUs);
+		if (!clean) break;
+		best.clockHz = hz;
+		best.frameUs = frameUs;
+		best.fps = 1000000 * (int64_t)frames / (elapsed > 0 ? elapsed : 1);
+	}
+
+	// Nothing clean, go back to where we started
+	int hz = best.clockHz ? best.clockHz : initial;
+	esp_err_t ret = ssd1306_set_clock(dev, hz);
+	if (result) *result = best;
+	if (ret != ESP_OK) return ret;
+	return best.clockHz ? ESP_OK : ESP_FAIL;
+}
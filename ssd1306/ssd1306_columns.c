@@ -0,0 +1,164 @@
+#include <string.h>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+#include "ssd1306.h"
+
+#define TAG "SSD1306"
+
+// Columns as words: bit n of a column is panel row n, so a vertical shift, rotate,
+// mask or fill of a column is one operation on a uint64_t (uint32_t on 128x32 panels).
+// With the column layout the words are the buffer itself (the ESP32 is little endian,
+// byte n of a word is page n), otherwise they are gathered from and scattered to the pages.
+
+static inline uint64_t column_rows(SSD1306_t * dev)
+{
+	return (dev->_panelPages == 8) ? ~0ULL : (1ULL << (dev->_panelPages * 8)) - 1;
+}
+
+static inline uint64_t column_load(SSD1306_t * dev, int x)
+{
+	if (dev->_fbColumns && dev->_panelPages == 8) {
+		uint64_t rows;
+		memcpy(&rows, &dev->_fb[x * 8], 8);
+		return rows;
+	}
+	if (dev->_fbColumns) {
+		uint32_t rows;
+		memcpy(&rows, &dev->_fb[x * 4], 4);
+		return rows;
+	}
+	uint64_t rows = 0;
+	for (int page=0; page<dev->_panelPages; page++) {
+		rows |= (uint64_t)dev->_fb[page * dev->_panelWidth + x] << (page * 8);
+	}
+	return rows;
+}
+
+static inline void column_store(SSD1306_t * dev, int x, uint64_t rows)
+{
+	if (dev->_fbColumns && dev->_panelPages == 8) {
+		memcpy(&dev->_fb[x * 8], &rows, 8);
+		return;
+	}
+	if (dev->_fbColumns) {
+		uint32_t _rows = rows;
+		memcpy(&dev->_fb[x * 4], &_rows, 4);
+		return;
+	}
+	for (int page=0; page<dev->_panelPages; page++) {
+		dev->_fb[page * dev->_panelWidth + x] = rows >> (page * 8);
+	}
+}
+
+// Clip columns x..x+width-1 to the panel, false when nothing is left
+static bool column_clip(SSD1306_t * dev, int * x, int * width)
+{
+	if (*x < 0) {
+		*width += *x;
+		*x = 0;
+	}
+	if (*x + *width > dev->_width) *width = dev->_width - *x;
+	return *width > 0;
+}
+
+// Mark the pages holding rows of columns x..x+width-1 dirty
+static void column_mark(SSD1306_t * dev, int x, int width, uint64_t rows)
+{
+	for (int page=0; page<dev->_panelPages; page++) {
+		if ((rows >> (page * 8)) & 0xFF) ssd1306_mark_dirty(dev, page, x, width);
+	}
+}
+
+// Keep the buffer one page after the other (LAYOUT_PAGES, the default) or one column
+// after the other (LAYOUT_COLUMNS). The column layout makes the column functions below
+// one load and one store per column, and a flush sends whole columns in vertical addressing
+// straight from the buffer. Row oriented updates such as text lines then cost whole
+// columns on the bus. Drawing works the same in both layouts, ssd1306_fb() does not.
+// Not in portrait mode and not while the double buffer runs. Nothing is sent.
+esp_err_t ssd1306_set_layout(SSD1306_t * dev, ssd1306_layout_t layout)
+{
+	bool columns = (layout == LAYOUT_COLUMNS);
+	if (columns == dev->_fbColumns) return ESP_OK;
+	if (dev->_canvas) return ESP_ERR_NOT_SUPPORTED;
+	if (dev->_flushTask) return ESP_ERR_INVALID_STATE;
+	size_t size = dev->_panelPages * dev->_panelWidth;
+	uint8_t * copy = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+	if (copy == NULL) return ESP_ERR_NO_MEM;
+	memcpy(copy, dev->_fb, size);
+	for (int page=0; page<dev->_panelPages; page++) {
+		for (int seg=0; seg<dev->_panelWidth; seg++) {
+			if (columns) {
+				dev->_fb[seg * dev->_panelPages + page] = copy[page * dev->_panelWidth + seg];
+			} else {
+				dev->_fb[page * dev->_panelWidth + seg] = copy[seg * dev->_panelPages + page];
+			}
+		}
+	}
+	heap_caps_free(copy);
+	dev->_fbColumns = columns;
+	ESP_LOGD(TAG, "layout %s", columns ? "columns" : "pages");
+	return ESP_OK;
+}
+
+// Rows of column x, bit n is row n. 0 outside the panel and in portrait mode.
+uint64_t ssd1306_get_column(SSD1306_t * dev, int x)
+{
+	if (dev->_canvas || x < 0 || x >= dev->_width) return 0;
+	return column_load(dev, x);
+}
+
+esp_err_t ssd1306_set_column(SSD1306_t * dev, int x, uint64_t rows)
+{
+	if (dev->_canvas) return ESP_ERR_NOT_SUPPORTED;
+	if (x < 0 || x >= dev->_width) return ESP_ERR_INVALID_ARG;
+	uint64_t changed = (column_load(dev, x) ^ rows) & column_rows(dev);
+	column_store(dev, x, rows);
+	column_mark(dev, x, 1, changed);
+	return ESP_OK;
+}
+
+// Set the rows of columns x..x+width-1 whose bit is set in rows, or clear them with invert.
+// A vertical line, a bar of a graph or a wipe is one call.
+esp_err_t ssd1306_fill_columns(SSD1306_t * dev, int x, int width, uint64_t rows, bool invert)
+{
+	if (dev->_canvas) return ESP_ERR_NOT_SUPPORTED;
+	rows &= column_rows(dev);
+	if (!column_clip(dev, &x, &width) || rows == 0) return ESP_OK;
+	for (int seg=x; seg<x + width; seg++) {
+		uint64_t wk = column_load(dev, seg);
+		column_store(dev, seg, invert ? (wk & ~rows) : (wk | rows));
+	}
+	column_mark(dev, x, width, rows);
+	return ESP_OK;
+}
+
+// Move the content of columns x..x+width-1 down by lines rows (up when negative).
+// rotate brings the rows leaving one edge back in at the other, otherwise blank rows come in.
+esp_err_t ssd1306_shift_columns(SSD1306_t * dev, int x, int width, int lines, bool rotate)
+{
+	if (dev->_canvas) return ESP_ERR_NOT_SUPPORTED;
+	if (!column_clip(dev, &x, &width)) return ESP_OK;
+	int height = dev->_panelPages * 8;
+	uint64_t mask = column_rows(dev);
+	if (rotate) {
+		lines = (lines % height + height) % height;
+	} else if (lines >= height || lines <= -height) {
+		return ssd1306_fill_columns(dev, x, width, mask, true);
+	}
+	if (lines == 0) return ESP_OK;
+	for (int seg=x; seg<x + width; seg++) {
+		uint64_t wk = column_load(dev, seg);
+		if (rotate) {
+			wk = (wk << lines) | (wk >> (height - lines));
+		} else if (lines > 0) {
+			wk <<= lines;
+		} else {
+			wk >>= -lines;
+		}
+		column_store(dev, seg, wk & mask);
+	}
+	column_mark(dev, x, width, mask);
+	return ESP_OK;
+}
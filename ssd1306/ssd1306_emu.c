@@ -0,0 +1,310 @@
+#include <string.h>
+
+#include "ssd1306_emu.h"
+
+// Power on state, see the command table of the datasheet
+void ssd1306_emu_reset(ssd1306_emu_t * emu)
+{
+	memset(emu, 0, sizeof(ssd1306_emu_t));
+	emu->addrMode = OLED_CMD_SET_PAGE_ADDR_MODE;
+	emu->columnEnd = SSD1306_EMU_COLUMNS - 1;
+	emu->pageEnd = SSD1306_EMU_PAGES - 1;
+	emu->mux = SSD1306_EMU_ROWS - 1;
+	emu->comPins = 0x12;
+	emu->contrast = 0x7F;
+	emu->scrollRows = SSD1306_EMU_ROWS;
+}
+
+void ssd1306_emu_reset_stats(ssd1306_emu_t * emu)
+{
+	emu->cmdBytes = 0;
+	emu->dataBytes = 0;
+	emu->unknownCmds = 0;
+}
+
+// Number of argument bytes following a command byte
+static int ssd1306_emu_args(uint8_t cmd)
+{
+	switch (cmd) {
+	case OLED_CMD_SET_CONTRAST:
+	case OLED_CMD_SET_MEMORY_ADDR_MODE:
+	case OLED_CMD_SET_MUX_RATIO:
+	case OLED_CMD_SET_DISPLAY_OFFSET:
+	case OLED_CMD_SET_COM_PIN_MAP:
+	case OLED_CMD_SET_DISPLAY_CLK_DIV:
+	case OLED_CMD_SET_PRECHARGE:
+	case OLED_CMD_SET_VCOMH_DESELCT:
+	case OLED_CMD_SET_CHARGE_PUMP:
+	case 0x23: // Fade out and blinking
+	case 0xD6: // Zoom in
+		return 1;
+	case OLED_CMD_SET_COLUMN_RANGE:
+	case OLED_CMD_SET_PAGE_RANGE:
+	case OLED_CMD_VERTICAL:
+		return 2;
+	case OLED_CMD_CONTINUOUS_SCROLL:
+	case 0x2A: // Vertical and left horizontal scroll
+		return 5;
+	case OLED_CMD_HORIZONTAL_RIGHT:
+	case OLED_CMD_HORIZONTAL_LEFT:
+	case 0x2C: // Right content scroll by one column
+	case 0x2D: // Left content scroll by one column
+		return 6;
+	default:
+		return 0;
+	}
+}
+
+// Rotate columns first..last of pages start..end by one, right when dir > 0
+static void ssd1306_emu_shift(ssd1306_emu_t * emu, int start, int end, int first, int last, int dir)
+{
+	if (last > SSD1306_EMU_COLUMNS - 1) last = SSD1306_EMU_COLUMNS - 1;
+	if (first > last) return;
+	for (int page=start; page<=end && page<SSD1306_EMU_PAGES; page++) {
+		uint8_t * segs = emu->gddram[page];
+		if (dir > 0) {
+			uint8_t wk = segs[last];
+			memmove(&segs[first + 1], &segs[first], last - first);
+			segs[first] = wk;
+		} else {
+			uint8_t wk = segs[first];
+			memmove(&segs[first], &segs[first + 1], last - first);
+			segs[last] = wk;
+		}
+	}
+}
+
+static void ssd1306_emu_execute(ssd1306_emu_t * emu)
+{
+	uint8_t * c = emu->cmd;
+
+	if (c[0] <= 0x0F) {
+		emu->column = (emu->column & 0xF0) | (c[0] & 0x0F);
+	} else if (c[0] <= 0x1F) {
+		emu->column = (emu->column & 0x0F) | ((c[0] & 0x07) << 4);
+	} else if (c[0] >= 0x40 && c[0] <= 0x7F) {
+		emu->startLine = c[0] & 0x3F;
+	} else if (c[0] >= 0xB0 && c[0] <= 0xB7) {
+		emu->page = c[0] & 0x07;
+	} else {
+		switch (c[0]) {
+		case OLED_CMD_SET_MEMORY_ADDR_MODE:
+			emu->addrMode = c[1] & 0x03;
+			break;
+		case OLED_CMD_SET_COLUMN_RANGE:
+			emu->columnStart = emu->column = c[1] & 0x7F;
+			emu->columnEnd = c[2] & 0x7F;
+			break;
+		case OLED_CMD_SET_PAGE_RANGE:
+			emu->pageStart = emu->page = c[1] & 0x07;
+			emu->pageEnd = c[2] & 0x07;
+			break;
+		case OLED_CMD_SET_CONTRAST:
+			emu->contrast = c[1];
+			break;
+		case OLED_CMD_DISPLAY_RAM:
+		case OLED_CMD_DISPLAY_ALLON:
+			emu->allOn = (c[0] == OLED_CMD_DISPLAY_ALLON);
+			break;
+		case OLED_CMD_DISPLAY_NORMAL:
+		case OLED_CMD_DISPLAY_INVERTED:
+			emu->inverted = (c[0] == OLED_CMD_DISPLAY_INVERTED);
+			break;
+		case OLED_CMD_DISPLAY_OFF:
+		case OLED_CMD_DISPLAY_ON:
+			emu->displayOn = (c[0] == OLED_CMD_DISPLAY_ON);
+			break;
+		case OLED_CMD_SET_SEGMENT_REMAP_0:
+		case OLED_CMD_SET_SEGMENT_REMAP_1:
+			emu->segRemap = (c[0] == OLED_CMD_SET_SEGMENT_REMAP_1);
+			break;
+		case 0xC0:
+		case OLED_CMD_SET_COM_SCAN_MODE:
+			emu->comRemap = (c[0] == OLED_CMD_SET_COM_SCAN_MODE);
+			break;
+		case OLED_CMD_SET_MUX_RATIO:
+			if ((c[1] & 0x3F) >= 15) emu->mux = c[1] & 0x3F;
+			break;
+		case OLED_CMD_SET_DISPLAY_OFFSET:
+			emu->offset = c[1] & 0x3F;
+			break;
+		case OLED_CMD_SET_COM_PIN_MAP:
+			emu->comPins = c[1];
+			break;
+		case 0x23:
+			emu->fade = c[1] & 0x3F;
+			break;
+		case 0xD6:
+			emu->zoom = c[1] & 0x01;
+			break;
+		case OLED_CMD_HORIZONTAL_RIGHT:
+		case OLED_CMD_HORIZONTAL_LEFT:
+		case OLED_CMD_CONTINUOUS_SCROLL:
+		case 0x2A:
+			emu->scrollCmd = c[0];
+			memcpy(emu->scrollArgs, &c[1], emu->cmdNeed);
+			emu->scrollPos = 0;
+			break;
+		case 0x2C:
+		case 0x2D:
+			ssd1306_emu_shift(emu, c[2] & 0x07, c[4] & 0x07, c[5] & 0x7F, c[6] & 0x7F, c[0] == 0x2C ? 1 : -1);
+			break;
+		case OLED_CMD_VERTICAL:
+			emu->scrollTop = c[1] & 0x3F;
+			emu->scrollRows = c[2] & 0x7F;
+			break;
+		case OLED_CMD_ACTIVE_SCROLL:
+			emu->scrollActive = true;
+			break;
+		case OLED_CMD_DEACTIVE_SCROLL:
+			emu->scrollActive = false;
+			break;
+		case OLED_CMD_SET_DISPLAY_CLK_DIV:
+		case OLED_CMD_SET_PRECHARGE:
+		case OLED_CMD_SET_VCOMH_DESELCT:
+		case OLED_CMD_SET_CHARGE_PUMP:
+		case OLED_CMD_NOP:
+			break;
+		default:
+			emu->unknownCmds++;
+			break;
+		}
+	}
+}
+
+void ssd1306_emu_command(ssd1306_emu_t * emu, const uint8_t * cmds, int len)
+{
+	emu->cmdBytes += len;
+	for (int i=0; i<len; i++) {
+		if (emu->cmdLen == 0) {
+			emu->cmdNeed = ssd1306_emu_args(cmds[i]);
+		}
+		emu->cmd[emu->cmdLen++] = cmds[i];
+		if (emu->cmdLen > emu->cmdNeed) {
+			ssd1306_emu_execute(emu);
+			emu->cmdLen = 0;
+		}
+	}
+}
+
+// Store at the address pointer and advance it the way the addressing mode does
+void ssd1306_emu_data(ssd1306_emu_t * emu, const uint8_t * data, int len)
+{
+	emu->dataBytes += len;
+	for (int i=0; i<len; i++) {
+		if (emu->column < SSD1306_EMU_COLUMNS) {
+			emu->gddram[emu->page][emu->column] = data[i];
+		}
+		if (emu->addrMode == OLED_CMD_SET_PAGE_ADDR_MODE) {
+			if (++emu->column > SSD1306_EMU_COLUMNS - 1) emu->column = 0;
+		} else if (emu->addrMode == OLED_CMD_SET_HORI_ADDR_MODE) {
+			if (++emu->column > emu->columnEnd) {
+				emu->column = emu->columnStart;
+				if (++emu->page > emu->pageEnd) emu->page = emu->pageStart;
+			}
+		} else {
+			if (++emu->page > emu->pageEnd) {
+				emu->page = emu->pageStart;
+				if (++emu->column > emu->columnEnd) emu->column = emu->columnStart;
+			}
+		}
+	}
+}
+
+// Decode the bytes of one I2C write after the address byte
+void ssd1306_emu_i2c(ssd1306_emu_t * emu, const uint8_t * bytes, int len)
+{
+	int i = 0;
+	while (i < len) {
+		uint8_t control = bytes[i++];
+		bool data = (control & OLED_CONTROL_BYTE_DATA_STREAM) != 0;
+		int n = (control & OLED_CONTROL_BYTE_CMD_SINGLE) ? 1 : len - i;
+		if (n > len - i) n = len - i;
+		if (data) {
+			ssd1306_emu_data(emu, &bytes[i], n);
+		} else {
+			ssd1306_emu_command(emu, &bytes[i], n);
+		}
+		i += n;
+	}
+}
+
+static void ssd1306_emu_on_write(void * arg, bool data, const uint8_t * bytes, int len)
+{
+	if (data) {
+		ssd1306_emu_data(arg, bytes, len);
+	} else {
+		ssd1306_emu_command(arg, bytes, len);
+	}
+}
+
+// Feed everything the mock transport sends into emu
+void ssd1306_emu_attach(ssd1306_emu_t * emu, ssd1306_mock_t * mock)
+{
+	mock->onWrite = ssd1306_emu_on_write;
+	mock->arg = emu;
+}
+
+// Advance an active continuous scroll by one step
+void ssd1306_emu_tick(ssd1306_emu_t * emu)
+{
+	if (emu->scrollActive == false) return;
+	uint8_t * a = emu->scrollArgs;
+	int dir = (emu->scrollCmd == OLED_CMD_HORIZONTAL_RIGHT || emu->scrollCmd == OLED_CMD_CONTINUOUS_SCROLL) ? 1 : -1;
+	ssd1306_emu_shift(emu, a[1] & 0x07, a[3] & 0x07, 0, SSD1306_EMU_COLUMNS - 1, dir);
+	if (emu->scrollCmd == OLED_CMD_CONTINUOUS_SCROLL || emu->scrollCmd == 0x2A) {
+		if (emu->scrollRows > 0) emu->scrollPos = (emu->scrollPos + (a[4] & 0x3F)) % emu->scrollRows;
+	}
+}
+
+int ssd1306_emu_height(ssd1306_emu_t * emu)
+{
+	return emu->mux + 1;
+}
+
+// Pixel at x, y of the glass. The glass is mounted so that the usual A1/C8
+// setup shows GDDRAM row 0 at the top and column 0 at the left.
+bool ssd1306_emu_pixel(ssd1306_emu_t * emu, int x, int y)
+{
+	int rows = emu->mux + 1;
+	if (x < 0 || x >= SSD1306_EMU_COLUMNS || y < 0 || y >= rows) return false;
+	if (emu->displayOn == false) return false;
+	if (emu->allOn) return true;
+
+	int com = emu->comRemap ? y : rows - 1 - y;
+	int row = (com + emu->startLine + emu->offset) % SSD1306_EMU_ROWS;
+	if (emu->scrollActive && emu->scrollPos && row >= emu->scrollTop && row < emu->scrollTop + emu->scrollRows) {
+		row = emu->scrollTop + (row - emu->scrollTop + emu->scrollPos) % emu->scrollRows;
+	}
+	int column = emu->segRemap ? x : SSD1306_EMU_COLUMNS - 1 - x;
+	bool on = (emu->gddram[row / 8][column] >> (row % 8)) & 1;
+	return on != emu->inverted;
+}
+
+// What the glass shows, in the page layout of ssd1306_get_buffer()
+void ssd1306_emu_frame(ssd1306_emu_t * emu, uint8_t * buffer)
+{
+	int rows = emu->mux + 1;
+	memset(buffer, 0, ((rows + 7) / 8) * SSD1306_EMU_COLUMNS);
+	for (int y=0; y<rows; y++) {
+		for (int x=0; x<SSD1306_EMU_COLUMNS; x++) {
+			if (ssd1306_emu_pixel(emu, x, y)) buffer[(y / 8) * SSD1306_EMU_COLUMNS + x] |= 1 << (y % 8);
+		}
+	}
+}
+
+// Binary PBM snapshot of the glass, lit pixels are black
+int ssd1306_emu_write_pbm(ssd1306_emu_t * emu, FILE * fp)
+{
+	int rows = emu->mux + 1;
+	if (fprintf(fp, "P4\n%d %d\n", SSD1306_EMU_COLUMNS, rows) < 0) return -1;
+	for (int y=0; y<rows; y++) {
+		uint8_t line[SSD1306_EMU_COLUMNS / 8];
+		memset(line, 0, sizeof(line));
+		for (int x=0; x<SSD1306_EMU_COLUMNS; x++) {
+			if (ssd1306_emu_pixel(emu, x, y)) line[x / 8] |= 0x80 >> (x % 8);
+		}
+		if (fwrite(line, 1, sizeof(line), fp) != sizeof(line)) return -1;
+	}
+	return 0;
+}
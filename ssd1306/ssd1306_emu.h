@@ -0,0 +1,75 @@
+#ifndef MAIN_SSD1306_EMU_H_
+#define MAIN_SSD1306_EMU_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ssd1306.h"
+
+// Model of the controller fed with the bytes the driver sends.
+// Keeps the 128x64 GDDRAM and the state the commands set, so output and
+// bus cost can be checked without a panel, on the device or on a host.
+
+#define SSD1306_EMU_COLUMNS 128
+#define SSD1306_EMU_PAGES   8
+#define SSD1306_EMU_ROWS    64
+
+typedef struct {
+	uint8_t gddram[SSD1306_EMU_PAGES][SSD1306_EMU_COLUMNS];
+
+	// Addressing
+	int addrMode;		// OLED_CMD_SET_HORI_ADDR_MODE, _VERT_ or _PAGE_
+	int column;
+	int page;
+	int columnStart;
+	int columnEnd;
+	int pageStart;
+	int pageEnd;
+
+	// Hardware configuration
+	bool segRemap;		// A1
+	bool comRemap;		// C8
+	int startLine;		// 40..7F
+	int offset;			// D3
+	int mux;			// A8, rows - 1
+	int comPins;		// DA
+	int contrast;		// 81
+	bool displayOn;		// AF
+	bool inverted;		// A7
+	bool allOn;			// A5
+	int fade;			// 23
+	bool zoom;			// D6
+
+	// Scrolling
+	bool scrollActive;
+	uint8_t scrollCmd;	// 26, 27, 29 or 2A
+	uint8_t scrollArgs[6];
+	int scrollTop;		// A3 fixed rows
+	int scrollRows;		// A3 rows in the scroll area
+	int scrollPos;		// Vertical scroll accumulated by ssd1306_emu_tick()
+
+	// Multi byte command being decoded
+	uint8_t cmd[8];
+	int cmdLen;
+	int cmdNeed;
+
+	// Traffic since the last ssd1306_emu_reset_stats()
+	int cmdBytes;
+	int dataBytes;
+	int unknownCmds;
+} ssd1306_emu_t;
+
+void ssd1306_emu_reset(ssd1306_emu_t * emu);
+void ssd1306_emu_reset_stats(ssd1306_emu_t * emu);
+void ssd1306_emu_command(ssd1306_emu_t * emu, const uint8_t * cmds, int len);
+void ssd1306_emu_data(ssd1306_emu_t * emu, const uint8_t * data, int len);
+void ssd1306_emu_i2c(ssd1306_emu_t * emu, const uint8_t * bytes, int len);
+void ssd1306_emu_attach(ssd1306_emu_t * emu, ssd1306_mock_t * mock);
+void ssd1306_emu_tick(ssd1306_emu_t * emu);
+int ssd1306_emu_height(ssd1306_emu_t * emu);
+bool ssd1306_emu_pixel(ssd1306_emu_t * emu, int x, int y);
+void ssd1306_emu_frame(ssd1306_emu_t * emu, uint8_t * buffer);
+int ssd1306_emu_write_pbm(ssd1306_emu_t * emu, FILE * fp);
+
+#endif /* MAIN_SSD1306_EMU_H_ */
@@ -0,0 +1,217 @@
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+
+#include "esp_log.h"
+
+#include "ssd1306.h"
+
+#define TAG "SSD1306"
+
+// Fades and blinking run from a FreeRTOS timer, one contrast or page update per step.
+// The caller is free while they run, but must not draw or write to the panel until
+// the fade finished (see ssd1306_fade_busy()) or was stopped.
+
+// Time between two contrast updates of a software fade
+#define FADE_STEP_MS 20
+// Frames per second with the oscillator set up by ssd1306_init() (D5h 80h, D9h 22h):
+// about 370kHz / (54 clocks per row * rows)
+#define FADE_FRAME_HZ(dev) (370000 / (54 * (dev)->_panelPages * 8))
+// Brightness steps of the controller fade, each lasting 8 * (interval + 1) frames
+#define FADE_HW_STEPS 16
+
+static void ssd1306_fade_cmds(SSD1306_t * dev, uint8_t c0, uint8_t c1)
+{
+	uint8_t cmds[2] = { c0, c1 };
+	dev->_ops->write_cmds(dev, cmds, 2);
+}
+
+// Fade/blink interval (A[3:0] of 23h) closest to duration_ms for the whole fade
+static int ssd1306_fade_interval(SSD1306_t * dev, int duration_ms)
+{
+	int interval = duration_ms * FADE_FRAME_HZ(dev) / (8 * FADE_HW_STEPS * 1000) - 1;
+	if (interval < 0) interval = 0;
+	if (interval > 0x0F) interval = 0x0F;
+	return interval;
+}
+
+static bool ssd1306_fade_hw(SSD1306_t * dev)
+{
+	return dev->_hwFade && (dev->_fadeType == FADE_OUT || dev->_fadeType == FADE_BLINK);
+}
+
+// One step of the wipe: page step / 8 is filled with the pattern of line step % 8
+static void ssd1306_wipe_step(SSD1306_t * dev, int step)
+{
+	int page = step / 8;
+	int line = step % 8;
+	uint8_t image = 0xFF << (line + 1);
+	if (dev->_fbColumns) {
+		for (int seg=0; seg<dev->_width; seg++) *ssd1306_fb_seg(dev, page, seg) = image;
+	} else {
+		memset(ssd1306_fb(dev, page), image, dev->_width);
+	}
+	ssd1306_mark_dirty(dev, page, 0, dev->_width);
+	ssd1306_flush(dev);
+}
+
+// Leave the panel the way the fade should end, or back to normal when it was stopped
+static void ssd1306_fade_restore(SSD1306_t * dev, bool stopped)
+{
+	if (ssd1306_fade_hw(dev)) {
+		ssd1306_fade_cmds(dev, OLED_CMD_SET_FADE_BLINK, 0x00);
+	}
+	if (dev->_fadeType == FADE_OUT && !stopped) {
+		uint8_t cmds[] = { OLED_CMD_DISPLAY_OFF, OLED_CMD_SET_CONTRAST, dev->_contrast };
+		dev->_ops->write_cmds(dev, cmds, sizeof(cmds));
+	} else if (dev->_fadeType != FADE_WIPE) {
+		uint8_t cmds[] = { OLED_CMD_SET_CONTRAST, dev->_contrast, OLED_CMD_DISPLAY_ON };
+		dev->_ops->write_cmds(dev, cmds, sizeof(cmds));
+	}
+}
+
+static void ssd1306_fade_timer(TimerHandle_t timer)
+{
+	SSD1306_t * dev = (SSD1306_t *)pvTimerGetTimerID(timer);
+	if (dev->_fadeType == FADE_NONE) return;
+
+	int step = dev->_fadeStep++;
+	int steps = dev->_fadeSteps;
+	if (!ssd1306_fade_hw(dev)) {
+		int level = -1;
+		if (dev->_fadeType == FADE_OUT) {
+			level = dev->_contrast * (steps - step - 1) / steps;
+		} else if (dev->_fadeType == FADE_IN) {
+			level = dev->_contrast * (step + 1) / steps;
+		} else if (dev->_fadeType == FADE_BLINK) {
+			// Down in the first half of a cycle, up in the second
+			int cycle = dev->_fadeCycle;
+			int half = cycle / 2;
+			int phase = step % cycle;
+			if (phase < half) {
+				level = dev->_contrast * (half - phase - 1) / half;
+			} else {
+				level = dev->_contrast * (phase - half + 1) / (cycle - half);
+			}
+		} else if (dev->_fadeType == FADE_WIPE) {
+			ssd1306_wipe_step(dev, step);
+		}
+		if (level >= 0) ssd1306_fade_cmds(dev, OLED_CMD_SET_CONTRAST, level);
+	}
+	if (steps == 0 || dev->_fadeStep < steps) return;
+
+	xTimerStop(timer, 0);
+	ssd1306_fade_restore(dev, false);
+	dev->_fadeType = FADE_NONE;
+	ESP_LOGD(TAG, "fade done");
+	if (dev->_fadeDone) dev->_fadeDone(dev, dev->_fadeArg);
+}
+
+static esp_err_t ssd1306_fade_run(SSD1306_t * dev, int period_ms)
+{
+	TickType_t period = pdMS_TO_TICKS(period_ms);
+	if (period == 0) period = 1;
+	if (dev->_fadeTimer == NULL) {
+		dev->_fadeTimer = xTimerCreate("ssd1306_fade", period, pdTRUE, dev, ssd1306_fade_timer);
+		if (dev->_fadeTimer == NULL) {
+			dev->_fadeType = FADE_NONE;
+			return ESP_ERR_NO_MEM;
+		}
+	}
+	// Also starts the timer
+	if (xTimerChangePeriod(dev->_fadeTimer, period, portMAX_DELAY) != pdPASS) {
+		dev->_fadeType = FADE_NONE;
+		return ESP_FAIL;
+	}
+	return ESP_OK;
+}
+
+// Start a fade lasting about duration_ms and return at once, done is called when it ends.
+// FADE_OUT and FADE_BLINK use the controller when CONFIG_SSD1306_HW_FADE is set,
+// everything else ramps the contrast or, for FADE_WIPE, sends one page per step.
+// A fade still running is stopped first.
+esp_err_t ssd1306_fade_start(SSD1306_t * dev, ssd1306_fade_type_t fade, int duration_ms, ssd1306_fade_cb_t done, void * arg)
+{
+	if (fade == FADE_NONE || fade == FADE_BLINK) return ESP_ERR_INVALID_ARG;
+	ssd1306_fade_stop(dev);
+	dev->_fadeType = fade;
+	dev->_fadeStep = 0;
+	dev->_fadeDone = done;
+	dev->_fadeArg = arg;
+
+	int period_ms = FADE_STEP_MS;
+	if (fade == FADE_WIPE) {
+		dev->_fadeSteps = dev->_pages * 8;
+		period_ms = duration_ms / dev->_fadeSteps;
+	} else if (ssd1306_fade_hw(dev)) {
+		ssd1306_fade_cmds(dev, OLED_CMD_SET_FADE_BLINK, 0x20 | ssd1306_fade_interval(dev, duration_ms));
+		dev->_fadeSteps = 1;
+		period_ms = duration_ms;
+	} else {
+		dev->_fadeSteps = duration_ms / FADE_STEP_MS;
+		if (dev->_fadeSteps < 1) dev->_fadeSteps = 1;
+	}
+	if (fade == FADE_IN) {
+		uint8_t cmds[] = { OLED_CMD_SET_CONTRAST, 0x00, OLED_CMD_DISPLAY_ON };
+		dev->_ops->write_cmds(dev, cmds, sizeof(cmds));
+	}
+	return ssd1306_fade_run(dev, period_ms);
+}
+
+// Blink count times, period_ms per blink. count 0 blinks until ssd1306_fade_stop().
+esp_err_t ssd1306_blink_start(SSD1306_t * dev, int period_ms, int count, ssd1306_fade_cb_t done, void * arg)
+{
+	if (period_ms <= 0 || count < 0) return ESP_ERR_INVALID_ARG;
+	ssd1306_fade_stop(dev);
+	dev->_fadeType = FADE_BLINK;
+	dev->_fadeStep = 0;
+	dev->_fadeDone = done;
+	dev->_fadeArg = arg;
+
+	if (ssd1306_fade_hw(dev)) {
+		// A blink fades out and back in, twice the steps of a fade
+		ssd1306_fade_cmds(dev, OLED_CMD_SET_FADE_BLINK, 0x30 | ssd1306_fade_interval(dev, period_ms / 2));
+		if (count == 0) return ESP_OK;
+		dev->_fadeSteps = 1;
+		return ssd1306_fade_run(dev, period_ms * count);
+	}
+	dev->_fadeCycle = period_ms / FADE_STEP_MS;
+	if (dev->_fadeCycle < 2) dev->_fadeCycle = 2;
+	dev->_fadeSteps = dev->_fadeCycle * count;
+	return ssd1306_fade_run(dev, FADE_STEP_MS);
+}
+
+// Cancel a running fade without calling its callback, the panel is left on at the set contrast
+void ssd1306_fade_stop(SSD1306_t * dev)
+{
+	if (dev->_fadeTimer) xTimerStop(dev->_fadeTimer, portMAX_DELAY);
+	if (dev->_fadeType == FADE_NONE) return;
+	ssd1306_fade_restore(dev, true);
+	dev->_fadeType = FADE_NONE;
+}
+
+bool ssd1306_fade_busy(SSD1306_t * dev)
+{
+	return dev->_fadeType != FADE_NONE;
+}
+
+// Double the height of every row, the upper half of the panel fills it.
+// Needs CONFIG_SSD1306_HW_FADE and the alternative COM pin configuration of 128x64 panels.
+esp_err_t ssd1306_zoom(SSD1306_t * dev, bool zoom)
+{
+	if (!dev->_hwFade || dev->_height != 64) return ESP_ERR_NOT_SUPPORTED;
+	ssd1306_fade_cmds(dev, OLED_CMD_SET_ZOOM, zoom ? 0x01 : 0x00);
+	return ESP_OK;
+}
+
+// Wipe the panel page by page and wait for it, one page transfer per step.
+// ssd1306_fade_start(FADE_WIPE) does the same without blocking.
+void ssd1306_fadeout(SSD1306_t * dev)
+{
+	for (int step=0; step<dev->_pages * 8; step++) {
+		ssd1306_wipe_step(dev, step);
+	}
+	ssd1306_wait(dev);
+}
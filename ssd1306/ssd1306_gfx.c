@@ -0,0 +1,383 @@
+#include "ssd1306.h"
+
+// Shapes drawn into the internal buffer, invert clears instead of sets.
+// Everything is clipped to the panel and only the clipped bounding box is marked
+// dirty, the next ssd1306_flush() sends it. Filled shapes are built from vertical
+// spans, which write whole bytes per page.
+
+// Clip the rectangle x0..x1-1, y0..y1-1 to the panel, false when nothing is left
+static bool gfx_clip(SSD1306_t * dev, int * x0, int * y0, int * x1, int * y1)
+{
+	if (*x0 < 0) *x0 = 0;
+	if (*y0 < 0) *y0 = 0;
+	if (*x1 > dev->_width) *x1 = dev->_width;
+	if (*y1 > dev->_height) *y1 = dev->_height;
+	return *x0 < *x1 && *y0 < *y1;
+}
+
+// Mark the clipped rectangle dirty, false when it is off the panel
+static bool gfx_mark(SSD1306_t * dev, int x0, int y0, int x1, int y1)
+{
+	if (!gfx_clip(dev, &x0, &y0, &x1, &y1)) return false;
+	for (int page=y0 / 8; page<=(y1 - 1) / 8; page++) {
+		ssd1306_mark_dirty(dev, page, x0, x1 - x0);
+	}
+	return true;
+}
+
+static inline void gfx_plot(SSD1306_t * dev, int x, int y, bool invert)
+{
+	if (x < 0 || y < 0 || x >= dev->_width || y >= dev->_height) return;
+	uint8_t * seg = ssd1306_fb_seg(dev, y >> 3, x);
+	if (invert) {
+		*seg &= ~(1 << (y & 7));
+	} else {
+		*seg |= 1 << (y & 7);
+	}
+}
+
+// Columns a line touched on the page it is crossing, marked dirty when it moves to the next page
+typedef struct {
+	int page;
+	int start;
+	int end;
+} gfx_span_t;
+
+static void gfx_span_end(SSD1306_t * dev, gfx_span_t * span)
+{
+	if (span->page >= 0) ssd1306_mark_dirty(dev, span->page, span->start, span->end - span->start + 1);
+	span->page = -1;
+}
+
+static inline void gfx_line_plot(SSD1306_t * dev, gfx_span_t * span, int x, int y, bool invert)
+{
+	if (x < 0 || y < 0 || x >= dev->_width || y >= dev->_height) return;
+	gfx_plot(dev, x, y, invert);
+	if ((y >> 3) != span->page) {
+		gfx_span_end(dev, span);
+		span->page = y >> 3;
+		span->start = x;
+		span->end = x;
+	} else if (x < span->start) {
+		span->start = x;
+	} else if (x > span->end) {
+		span->end = x;
+	}
+}
+
+// Rows y0..y1-1 of columns x0..x1-1, one mask per page. They are set, cleared with
+// invert or, with toggle, inverted.
+static void gfx_rows(SSD1306_t * dev, int x0, int y0, int x1, int y1, bool invert, bool toggle)
+{
+	if (!gfx_clip(dev, &x0, &y0, &x1, &y1)) return;
+	if (dev->_fbColumns) {
+		// One mask per column
+		uint64_t rows = (y1 - y0 == 64) ? ~0ULL : ((1ULL << (y1 - y0)) - 1) << y0;
+		if (!toggle) {
+			ssd1306_fill_columns(dev, x0, x1 - x0, rows, invert);
+			return;
+		}
+		for (int x=x0; x<x1; x++) {
+			ssd1306_set_column(dev, x, ssd1306_get_column(dev, x) ^ rows);
+		}
+		return;
+	}
+	int first = y0 / 8;
+	int last = (y1 - 1) / 8;
+	for (int page=first; page<=last; page++) {
+		uint8_t mask = 0xFF;
+		if (page == first) mask &= 0xFF << (y0 & 7);
+		if (page == last) mask &= 0xFF >> (7 - ((y1 - 1) & 7));
+		uint8_t * segs = ssd1306_fb(dev, page);
+		if (toggle) {
+			ssd1306_invert_mask(&segs[x0], x1 - x0, mask);
+		} else {
+			ssd1306_fill(&segs[x0], x1 - x0, invert ? 0x00 : 0xFF, mask);
+		}
+		ssd1306_mark_dirty(dev, page, x0, x1 - x0);
+	}
+}
+
+static void gfx_fill(SSD1306_t * dev, int x0, int y0, int x1, int y1, bool invert)
+{
+	gfx_rows(dev, x0, y0, x1, y1, invert, false);
+}
+
+void ssd1306_draw_hline(SSD1306_t * dev, int x, int y, int width, bool invert)
+{
+	gfx_fill(dev, x, y, x + width, y + 1, invert);
+}
+
+void ssd1306_draw_vline(SSD1306_t * dev, int x, int y, int height, bool invert)
+{
+	gfx_fill(dev, x, y, x + 1, y + height, invert);
+}
+
+void ssd1306_fill_rect(SSD1306_t * dev, int x, int y, int width, int height, bool invert)
+{
+	gfx_fill(dev, x, y, x + width, y + height, invert);
+}
+
+// Invert the pixels of the rectangle, a selection or a cursor drawn over anything
+void ssd1306_invert_rect(SSD1306_t * dev, int x, int y, int width, int height)
+{
+	gfx_rows(dev, x, y, x + width, y + height, false, true);
+}
+
+void ssd1306_draw_rect(SSD1306_t * dev, int x, int y, int width, int height, bool invert)
+{
+	if (width <= 0 || height <= 0) return;
+	gfx_fill(dev, x, y, x + width, y + 1, invert);
+	gfx_fill(dev, x, y + height - 1, x + width, y + height, invert);
+	gfx_fill(dev, x, y + 1, x + 1, y + height - 1, invert);
+	gfx_fill(dev, x + width - 1, y + 1, x + width, y + height - 1, invert);
+}
+
+// Set line to internal buffer. Not show it.
+void _ssd1306_line(SSD1306_t * dev, int x1, int y1, int x2, int y2,  bool invert)
+{
+	int i;
+	int dx,dy;
+	int sx,sy;
+	int E;
+
+	if (y1 == y2) {
+		gfx_fill(dev, x1 < x2 ? x1 : x2, y1, (x1 < x2 ? x2 : x1) + 1, y1 + 1, invert);
+		return;
+	}
+	if (x1 == x2) {
+		gfx_fill(dev, x1, y1 < y2 ? y1 : y2, x1 + 1, (y1 < y2 ? y2 : y1) + 1, invert);
+		return;
+	}
+	int _x0 = x1 < x2 ? x1 : x2;
+	int _y0 = y1 < y2 ? y1 : y2;
+	int _x1 = (x1 < x2 ? x2 : x1) + 1;
+	int _y1 = (y1 < y2 ? y2 : y1) + 1;
+	if (!gfx_clip(dev, &_x0, &_y0, &_x1, &_y1)) return;
+	// Only the columns the line crosses on each page become dirty
+	gfx_span_t span = { .page = -1 };
+
+	/* distance between two points */
+	dx = ( x2 > x1 ) ? x2 - x1 : x1 - x2;
+	dy = ( y2 > y1 ) ? y2 - y1 : y1 - y2;
+
+	/* direction of two point */
+	sx = ( x2 > x1 ) ? 1 : -1;
+	sy = ( y2 > y1 ) ? 1 : -1;
+
+	/* inclination < 1 */
+	if ( dx > dy ) {
+		E = -dx;
+		for ( i = 0 ; i <= dx ; i++ ) {
+			gfx_line_plot(dev, &span, x1, y1, invert);
+			x1 += sx;
+			E += 2 * dy;
+			if ( E >= 0 ) {
+				y1 += sy;
+				E -= 2 * dx;
+			}
+		}
+
+	/* inclination >= 1 */
+	} else {
+		E = -dy;
+		for ( i = 0 ; i <= dy ; i++ ) {
+			gfx_line_plot(dev, &span, x1, y1, invert);
+			y1 += sy;
+			E += 2 * dx;
+			if ( E >= 0 ) {
+				x1 += sx;
+				E -= 2 * dy;
+			}
+		}
+	}
+	gfx_span_end(dev, &span);
+}
+
+// Connect count points, and the last one back to the first when closed
+void ssd1306_draw_polyline(SSD1306_t * dev, const ssd1306_point_t * points, int count, bool closed, bool invert)
+{
+	for (int i=1; i<count; i++) {
+		_ssd1306_line(dev, points[i-1].x, points[i-1].y, points[i].x, points[i].y, invert);
+	}
+	if (closed && count > 2) {
+		_ssd1306_line(dev, points[count-1].x, points[count-1].y, points[0].x, points[0].y, invert);
+	}
+}
+
+// Quarter circles of radius r around cx, cy. corners: 1 top left, 2 top right, 4 bottom right, 8 bottom left.
+static void gfx_corners(SSD1306_t * dev, int cx, int cy, int r, int corners, bool invert)
+{
+	int f = 1 - r;
+	int ddx = 1;
+	int ddy = -2 * r;
+	int x = 0;
+	int y = r;
+	while (x < y) {
+		if (f >= 0) {
+			y--;
+			ddy += 2;
+			f += ddy;
+		}
+		x++;
+		ddx += 2;
+		f += ddx;
+		if (corners & 1) {
+			gfx_plot(dev, cx - y, cy - x, invert);
+			gfx_plot(dev, cx - x, cy - y, invert);
+		}
+		if (corners & 2) {
+			gfx_plot(dev, cx + x, cy - y, invert);
+			gfx_plot(dev, cx + y, cy - x, invert);
+		}
+		if (corners & 4) {
+			gfx_plot(dev, cx + x, cy + y, invert);
+			gfx_plot(dev, cx + y, cy + x, invert);
+		}
+		if (corners & 8) {
+			gfx_plot(dev, cx - y, cy + x, invert);
+			gfx_plot(dev, cx - x, cy + y, invert);
+		}
+	}
+}
+
+// Vertical spans filling the right (sides 1) and left (sides 2) halves of a circle
+// of radius r around cx, cy, stretched down by delta rows. The centre column is left out.
+static void gfx_fill_corners(SSD1306_t * dev, int cx, int cy, int r, int sides, int delta, bool invert)
+{
+	int f = 1 - r;
+	int ddx = 1;
+	int ddy = -2 * r;
+	int x = 0;
+	int y = r;
+	int px = x;
+	int py = y;
+	while (x < y) {
+		if (f >= 0) {
+			y--;
+			ddy += 2;
+			f += ddy;
+		}
+		x++;
+		ddx += 2;
+		f += ddx;
+		// Columns at distance y are only drawn once, when they are the widest
+		if (x < y + 1) {
+			if (sides & 1) gfx_fill(dev, cx + x, cy - y, cx + x + 1, cy + y + 1 + delta, invert);
+			if (sides & 2) gfx_fill(dev, cx - x, cy - y, cx - x + 1, cy + y + 1 + delta, invert);
+		}
+		if (y != py) {
+			if (sides & 1) gfx_fill(dev, cx + py, cy - px, cx + py + 1, cy + px + 1 + delta, invert);
+			if (sides & 2) gfx_fill(dev, cx - py, cy - px, cx - py + 1, cy + px + 1 + delta, invert);
+			py = y;
+		}
+		px = x;
+	}
+}
+
+void ssd1306_draw_circle(SSD1306_t * dev, int cx, int cy, int r, bool invert)
+{
+	if (r < 0 || !gfx_mark(dev, cx - r, cy - r, cx + r + 1, cy + r + 1)) return;
+	gfx_plot(dev, cx, cy + r, invert);
+	gfx_plot(dev, cx, cy - r, invert);
+	gfx_plot(dev, cx + r, cy, invert);
+	gfx_plot(dev, cx - r, cy, invert);
+	gfx_corners(dev, cx, cy, r, 0x0F, invert);
+}
+
+void ssd1306_fill_circle(SSD1306_t * dev, int cx, int cy, int r, bool invert)
+{
+	if (r < 0 || !gfx_mark(dev, cx - r, cy - r, cx + r + 1, cy + r + 1)) return;
+	gfx_fill(dev, cx, cy - r, cx + 1, cy + r + 1, invert);
+	gfx_fill_corners(dev, cx, cy, r, 3, 0, invert);
+}
+
+static int gfx_radius(int width, int height, int r)
+{
+	int max = (width < height ? width : height) / 2;
+	if (r > max) r = max;
+	return r < 0 ? 0 : r;
+}
+
+void ssd1306_draw_round_rect(SSD1306_t * dev, int x, int y, int width, int height, int r, bool invert)
+{
+	if (width <= 0 || height <= 0) return;
+	if (!gfx_mark(dev, x, y, x + width, y + height)) return;
+	r = gfx_radius(width, height, r);
+	gfx_fill(dev, x + r, y, x + width - r, y + 1, invert);
+	gfx_fill(dev, x + r, y + height - 1, x + width - r, y + height, invert);
+	gfx_fill(dev, x, y + r, x + 1, y + height - r, invert);
+	gfx_fill(dev, x + width - 1, y + r, x + width, y + height - r, invert);
+	gfx_corners(dev, x + r, y + r, r, 1, invert);
+	gfx_corners(dev, x + width - r - 1, y + r, r, 2, invert);
+	gfx_corners(dev, x + width - r - 1, y + height - r - 1, r, 4, invert);
+	gfx_corners(dev, x + r, y + height - r - 1, r, 8, invert);
+}
+
+void ssd1306_fill_round_rect(SSD1306_t * dev, int x, int y, int width, int height, int r, bool invert)
+{
+	if (width <= 0 || height <= 0) return;
+	if (!gfx_mark(dev, x, y, x + width, y + height)) return;
+	r = gfx_radius(width, height, r);
+	int delta = height - 2 * r - 1;
+	gfx_fill(dev, x + r, y, x + width - r, y + height, invert);
+	gfx_fill_corners(dev, x + width - r - 1, y + r, r, 1, delta, invert);
+	gfx_fill_corners(dev, x + r, y + r, r, 2, delta, invert);
+	// A side of exactly 2 * r puts the far corners a step before the near ones, so
+	// the spans through the two middle rows or columns come out empty. Fill them here.
+	if (r > 0 && delta < 0) {
+		gfx_fill(dev, x, y + r - 1, x + 1, y + r + 1, invert);
+		gfx_fill(dev, x + width - 1, y + r - 1, x + width, y + r + 1, invert);
+	}
+	if (r > 0 && width - 2 * r - 1 < 0) {
+		gfx_fill(dev, x + r - 1, y, x + r + 1, y + height, invert);
+	}
+}
+
+void ssd1306_draw_triangle(SSD1306_t * dev, int x0, int y0, int x1, int y1, int x2, int y2, bool invert)
+{
+	_ssd1306_line(dev, x0, y0, x1, y1, invert);
+	_ssd1306_line(dev, x1, y1, x2, y2, invert);
+	_ssd1306_line(dev, x2, y2, x0, y0, invert);
+}
+
+// Row of the edge from x0, y0 to x1, y1 at column x, rounded to nearest
+static inline int gfx_edge(int x0, int y0, int x1, int y1, int x)
+{
+	if (x1 == x0) return y0;
+	int num = (y1 - y0) * (x - x0) * 2 + (x1 - x0);
+	int den = (x1 - x0) * 2;
+	// Floor division, num may be negative
+	return y0 + (num >= 0 ? num / den : -((-num + den - 1) / den));
+}
+
+// One vertical span per column between the long edge and the two short ones
+void ssd1306_fill_triangle(SSD1306_t * dev, int x0, int y0, int x1, int y1, int x2, int y2, bool invert)
+{
+	int t;
+	// Sort by column, x0 <= x1 <= x2
+	if (x0 > x1) { t = x0; x0 = x1; x1 = t; t = y0; y0 = y1; y1 = t; }
+	if (x1 > x2) { t = x1; x1 = x2; x2 = t; t = y1; y1 = y2; y2 = t; }
+	if (x0 > x1) { t = x0; x0 = x1; x1 = t; t = y0; y0 = y1; y1 = t; }
+	int top = y0 < y1 ? (y0 < y2 ? y0 : y2) : (y1 < y2 ? y1 : y2);
+	int bottom = y0 > y1 ? (y0 > y2 ? y0 : y2) : (y1 > y2 ? y1 : y2);
+	if (!gfx_mark(dev, x0, top, x2 + 1, bottom + 1)) return;
+
+	if (x0 == x2) {
+		gfx_fill(dev, x0, top, x0 + 1, bottom + 1, invert);
+		return;
+	}
+	int first = x0 < 0 ? 0 : x0;
+	int last = x2 >= dev->_width ? dev->_width - 1 : x2;
+	for (int x=first; x<=last; x++) {
+		int a = gfx_edge(x0, y0, x2, y2, x);
+		int b;
+		if (x < x1 || x1 == x2) {
+			b = gfx_edge(x0, y0, x1, y1, x);
+		} else {
+			b = gfx_edge(x1, y1, x2, y2, x);
+		}
+		if (a > b) { t = a; a = b; b = t; }
+		gfx_fill(dev, x, a, x + 1, b + 1, invert);
+	}
+}
@@ -4,19 +4,63 @@
 #include "freertos/task.h"
 
 #include "driver/i2c.h"
+#include "esp_heap_caps.h"
 #include "esp_log.h"
 
 #include "ssd1306.h"
 
 #define tag "SSD1306"
 
+// Port used by i2c_master_init(), other ports go through i2c_master_init_bus()
 #define I2C_NUM I2C_NUM_0
 //#define I2C_NUM I2C_NUM_1
 
+#ifdef CONFIG_SSD1306_I2C_CLOCK
+#define I2C_MASTER_FREQ_HZ CONFIG_SSD1306_I2C_CLOCK
+#else
 #define I2C_MASTER_FREQ_HZ 400000 /*!< I2C master clock frequency. no higher than 1MHz for now */
-
+#endif
+
+// Ticks to wait for a transaction carrying len bytes, a full frame takes longer than the usual 10ms
+#define I2C_TICKS_TO_WAIT(dev, len) ((10 + ((len) * 9 * 1000) / (dev)->_clockHz) / portTICK_PERIOD_MS + 1)
+
+// Link of the largest transaction: address, control and positioning bytes, then one write per row.
+// Every panel builds its links in a buffer of this size allocated once, nothing is allocated per transfer.
+#define I2C_LINK_WRITES (2 + SSD1306_I2C_LINK_ROWS)
+#define I2C_LINK_SIZE I2C_LINK_RECOMMENDED_SIZE(I2C_LINK_WRITES)
+// Positioning commands of one window, see ssd1306_window_cmds()
+#define I2C_WINDOW_CMDS 8
+
+// Configuration of every port set up by i2c_master_init_bus(), kept to change the clock later
+static i2c_config_t i2c_bus_config[I2C_NUM_MAX];
+
+static void i2c_init(SSD1306_t * dev);
+static void i2c_write_cmds(SSD1306_t * dev, const uint8_t * cmds, int len);
+static void i2c_write_data(SSD1306_t * dev, const uint8_t * data, int len);
+static void i2c_write_window(SSD1306_t * dev, const uint8_t * cmds, int len, const uint8_t * data, int stride, int rows, int width);
+static esp_err_t i2c_set_clock(SSD1306_t * dev, int hz);
+
+static const ssd1306_bus_ops_t i2c_bus_ops = {
+	.init = i2c_init,
+	.write_cmds = i2c_write_cmds,
+	.write_data = i2c_write_data,
+	.write_window = i2c_write_window,
+	.flush_async = i2c_write_window, // I2C transfers complete before returning
+	.wait = NULL,
+	.set_clock = i2c_set_clock,
+};
+
+// One panel at I2CAddress on I2C_NUM
 void i2c_master_init(SSD1306_t * dev, int16_t sda, int16_t scl, int16_t reset)
 {
+	ESP_ERROR_CHECK(i2c_master_init_bus(I2C_NUM, sda, scl));
+	i2c_master_init_device(dev, I2C_NUM, I2CAddress, reset);
+}
+
+// Install the driver of port once, every panel on it is then added with i2c_master_init_device()
+esp_err_t i2c_master_init_bus(int port, int16_t sda, int16_t scl)
+{
+	if (port < 0 || port >= I2C_NUM_MAX) return ESP_ERR_INVALID_ARG;
 	i2c_config_t i2c_config = {
 		.mode = I2C_MODE_MASTER,
 		.sda_io_num = sda,
@@ -25,9 +69,16 @@ void i2c_master_init(SSD1306_t * dev, int16_t sda, int16_t scl, int16_t reset)
 		.scl_pullup_en = GPIO_PULLUP_ENABLE,
 		.master.clk_speed = I2C_MASTER_FREQ_HZ
 	};
-	ESP_ERROR_CHECK(i2c_param_config(I2C_NUM, &i2c_config));
-	ESP_ERROR_CHECK(i2c_driver_install(I2C_NUM, I2C_MODE_MASTER, 0, 0, 0));
+	esp_err_t ret = i2c_param_config(port, &i2c_config);
+	if (ret != ESP_OK) return ret;
+	i2c_bus_config[port] = i2c_config;
+	return i2c_driver_install(port, I2C_MODE_MASTER, 0, 0, 0);
+}
 
+// Panel at address (0x3C or 0x3D) on a port set up by i2c_master_init_bus().
+// reset < 0 when the panel has no reset line or shares one that was already pulsed.
+void i2c_master_init_device(SSD1306_t * dev, int port, int address, int16_t reset)
+{
 	if (reset >= 0) {
 		//gpio_pad_select_gpio(reset);
 		gpio_reset_pin(reset);
@@ -36,212 +87,126 @@ void i2c_master_init(SSD1306_t * dev, int16_t sda, int16_t scl, int16_t reset)
 		vTaskDelay(50 / portTICK_PERIOD_MS);
 		gpio_set_level(reset, 1);
 	}
-	dev->_address = I2CAddress;
+	// Link buffer, kept for the life of the panel and reused when it is set up again
+	uint8_t * link = NULL;
+	if (ssd1306_release(dev) && dev->_ops == &i2c_bus_ops) link = dev->_busCtx;
+	if (link == NULL) link = heap_caps_malloc(I2C_LINK_SIZE, MALLOC_CAP_8BIT);
+	assert(link);
+	dev->_address = address;
+	dev->_i2cPort = port;
 	dev->_flip = false;
+	dev->_flushTask = NULL;
+	dev->_sched = NULL;
+	dev->_transferDone = NULL;
+	dev->_fadeTimer = NULL;
+	dev->_fadeType = FADE_NONE;
+	dev->_canvas = NULL;
+	dev->_fb = NULL;
+	dev->_fbOwned = false;
+	dev->_fbCaps = MALLOC_CAP_8BIT;
+	dev->_initKey = SSD1306_INIT_KEY(dev);
+	dev->_ops = &i2c_bus_ops;
+	dev->_busCtx = link;
+	dev->_clockHz = i2c_bus_config[port].master.clk_speed;
+	dev->_busErrors = 0;
 }
 
-void i2c_init(SSD1306_t * dev, int width, int height) {
-	dev->_width = width;
-	dev->_height = height;
-	dev->_pages = 8;
-	if (dev->_height == 32) dev->_pages = 4;
-	
-	i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+// The clock belongs to the port, every panel on it runs at the new rate
+static esp_err_t i2c_set_clock(SSD1306_t * dev, int hz)
+{
+	i2c_config_t i2c_config = i2c_bus_config[dev->_i2cPort];
+	i2c_config.master.clk_speed = hz;
+	esp_err_t ret = i2c_param_config(dev->_i2cPort, &i2c_config);
+	if (ret != ESP_OK) return ret;
+	i2c_bus_config[dev->_i2cPort] = i2c_config;
+	dev->_clockHz = hz;
+	return ESP_OK;
+}
 
+static i2c_cmd_handle_t i2c_link_begin(SSD1306_t * dev)
+{
+	i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(dev->_busCtx, I2C_LINK_SIZE);
 	i2c_master_start(cmd);
 	i2c_master_write_byte(cmd, (dev->_address << 1) | I2C_MASTER_WRITE, true);
-	i2c_master_write_byte(cmd, OLED_CONTROL_BYTE_CMD_STREAM, true);
-	i2c_master_write_byte(cmd, OLED_CMD_DISPLAY_OFF, true);				// AE
-	i2c_master_write_byte(cmd, OLED_CMD_SET_MUX_RATIO, true);			// A8
-	if (dev->_height == 64) i2c_master_write_byte(cmd, 0x3F, true);
-	if (dev->_height == 32) i2c_master_write_byte(cmd, 0x1F, true);
-	i2c_master_write_byte(cmd, OLED_CMD_SET_DISPLAY_OFFSET, true);		// D3
-	i2c_master_write_byte(cmd, 0x00, true);
-	i2c_master_write_byte(cmd, OLED_CONTROL_BYTE_DATA_STREAM, true);	// 40
-	//i2c_master_write_byte(cmd, OLED_CMD_SET_SEGMENT_REMAP, true);		// A1
-	if (dev->_flip) {
-		i2c_master_write_byte(cmd, OLED_CMD_SET_SEGMENT_REMAP_0, true);		// A0
-	} else {
-		i2c_master_write_byte(cmd, OLED_CMD_SET_SEGMENT_REMAP_1, true);		// A1
-	}
-	i2c_master_write_byte(cmd, OLED_CMD_SET_COM_SCAN_MODE, true);		// C8
-	i2c_master_write_byte(cmd, OLED_CMD_SET_DISPLAY_CLK_DIV, true);		// D5
-	i2c_master_write_byte(cmd, 0x80, true);
-	i2c_master_write_byte(cmd, OLED_CMD_SET_COM_PIN_MAP, true);			// DA
-	if (dev->_height == 64) i2c_master_write_byte(cmd, 0x12, true);
-	if (dev->_height == 32) i2c_master_write_byte(cmd, 0x02, true);
-	i2c_master_write_byte(cmd, OLED_CMD_SET_CONTRAST, true);			// 81
-	i2c_master_write_byte(cmd, 0xFF, true);
-	i2c_master_write_byte(cmd, OLED_CMD_DISPLAY_RAM, true);				// A4
-	i2c_master_write_byte(cmd, OLED_CMD_SET_VCOMH_DESELCT, true);		// DB
-	i2c_master_write_byte(cmd, 0x40, true);
-	i2c_master_write_byte(cmd, OLED_CMD_SET_MEMORY_ADDR_MODE, true);	// 20
-	//i2c_master_write_byte(cmd, OLED_CMD_SET_HORI_ADDR_MODE, true);	// 00
-	i2c_master_write_byte(cmd, OLED_CMD_SET_PAGE_ADDR_MODE, true);		// 02
-	// Set Lower Column Start Address for Page Addressing Mode
-	i2c_master_write_byte(cmd, 0x00, true);
-	// Set Higher Column Start Address for Page Addressing Mode
-	i2c_master_write_byte(cmd, 0x10, true);
-	i2c_master_write_byte(cmd, OLED_CMD_SET_CHARGE_PUMP, true);			// 8D
-	i2c_master_write_byte(cmd, 0x14, true);
-	i2c_master_write_byte(cmd, OLED_CMD_DEACTIVE_SCROLL, true);			// 2E
-	i2c_master_write_byte(cmd, OLED_CMD_DISPLAY_NORMAL, true);			// A6
-	i2c_master_write_byte(cmd, OLED_CMD_DISPLAY_ON, true);				// AF
+	return cmd;
+}
 
+// Send the link carrying len bytes and report the result
+static esp_err_t i2c_link_end(SSD1306_t * dev, i2c_cmd_handle_t cmd, int len, const char * what)
+{
 	i2c_master_stop(cmd);
-
-	esp_err_t espRc = i2c_master_cmd_begin(I2C_NUM, cmd, 10/portTICK_PERIOD_MS);
-	if (espRc == ESP_OK) {
-		ESP_LOGI(tag, "OLED configured successfully");
-	} else {
-		ESP_LOGE(tag, "OLED configuration failed. code: 0x%.2X", espRc);
+	esp_err_t espRc = i2c_master_cmd_begin(dev->_i2cPort, cmd, I2C_TICKS_TO_WAIT(dev, len));
+	i2c_cmd_link_delete_static(cmd);
+	if (espRc != ESP_OK) {
+		ESP_LOGE(tag, "%s write failed. code: 0x%.2X", what, espRc);
+		dev->_busErrors++;
 	}
-	i2c_cmd_link_delete(cmd);
+	if (dev->_transferDone) dev->_transferDone(dev, espRc, dev->_transferArg);
+	return espRc;
 }
 
-
-void i2c_display_image(SSD1306_t * dev, int page, int seg, uint8_t * images, int width) {
-	i2c_cmd_handle_t cmd;
-
-	if (page >= dev->_pages) return;
-	if (seg >= dev->_width) return;
-
-	int _seg = seg + CONFIG_OFFSETX;
-	uint8_t columLow = _seg & 0x0F;
-	uint8_t columHigh = (_seg >> 4) & 0x0F;
-
-	int _page = page;
-	if (dev->_flip) {
-		_page = (dev->_pages - page) - 1;
-	}
-
-	cmd = i2c_cmd_link_create();
+// Check that the panel acknowledges its address
+static void i2c_init(SSD1306_t * dev) {
+	i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(dev->_busCtx, I2C_LINK_SIZE);
 	i2c_master_start(cmd);
 	i2c_master_write_byte(cmd, (dev->_address << 1) | I2C_MASTER_WRITE, true);
-
-	i2c_master_write_byte(cmd, OLED_CONTROL_BYTE_CMD_STREAM, true);
-	// Set Lower Column Start Address for Page Addressing Mode
-	i2c_master_write_byte(cmd, (0x00 + columLow), true);
-	// Set Higher Column Start Address for Page Addressing Mode
-	i2c_master_write_byte(cmd, (0x10 + columHigh), true);
-	// Set Page Start Address for Page Addressing Mode
-	i2c_master_write_byte(cmd, 0xB0 | _page, true);
-
 	i2c_master_stop(cmd);
-	i2c_master_cmd_begin(I2C_NUM, cmd, 10/portTICK_PERIOD_MS);
-	i2c_cmd_link_delete(cmd);
-
-	cmd = i2c_cmd_link_create();
-	i2c_master_start(cmd);
-	i2c_master_write_byte(cmd, (dev->_address << 1) | I2C_MASTER_WRITE, true);
-
-	i2c_master_write_byte(cmd, OLED_CONTROL_BYTE_DATA_STREAM, true);
-	i2c_master_write(cmd, images, width, true);
 
-	i2c_master_stop(cmd);
-	i2c_master_cmd_begin(I2C_NUM, cmd, 10/portTICK_PERIOD_MS);
-	i2c_cmd_link_delete(cmd);
+	esp_err_t espRc = i2c_master_cmd_begin(dev->_i2cPort, cmd, 10/portTICK_PERIOD_MS);
+	if (espRc == ESP_OK) {
+		ESP_LOGI(tag, "OLED found at 0x%.2X", dev->_address);
+	} else {
+		ESP_LOGE(tag, "OLED not found at 0x%.2X. code: 0x%.2X", dev->_address, espRc);
+	}
+	i2c_cmd_link_delete_static(cmd);
 }
 
-void i2c_contrast(SSD1306_t * dev, int contrast) {
-	i2c_cmd_handle_t cmd;
-	int _contrast = contrast;
-	if (contrast < 0x0) _contrast = 0;
-	if (contrast > 0xFF) _contrast = 0xFF;
-
-	cmd = i2c_cmd_link_create();
-	i2c_master_start(cmd);
-	i2c_master_write_byte(cmd, (dev->_address << 1) | I2C_MASTER_WRITE, true);
+static void i2c_write_cmds(SSD1306_t * dev, const uint8_t * cmds, int len) {
+	i2c_cmd_handle_t cmd = i2c_link_begin(dev);
 	i2c_master_write_byte(cmd, OLED_CONTROL_BYTE_CMD_STREAM, true);
-	i2c_master_write_byte(cmd, OLED_CMD_SET_CONTRAST, true);			// 81
-	i2c_master_write_byte(cmd, _contrast, true);
-	i2c_master_stop(cmd);
-	i2c_master_cmd_begin(I2C_NUM, cmd, 10/portTICK_PERIOD_MS);
-	i2c_cmd_link_delete(cmd);
+	i2c_master_write(cmd, cmds, len, true);
+	i2c_link_end(dev, cmd, len, "Command");
 }
 
+static void i2c_write_data(SSD1306_t * dev, const uint8_t * data, int len) {
+	i2c_cmd_handle_t cmd = i2c_link_begin(dev);
+	i2c_master_write_byte(cmd, OLED_CONTROL_BYTE_DATA_STREAM, true);
+	i2c_master_write(cmd, data, len, true);
+	i2c_link_end(dev, cmd, len, "Data");
+}
 
-void i2c_hardware_scroll(SSD1306_t * dev, ssd1306_scroll_type_t scroll) {
-	esp_err_t espRc;
-
-	i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-	i2c_master_start(cmd);
-
-	i2c_master_write_byte(cmd, (dev->_address << 1) | I2C_MASTER_WRITE, true);
-	i2c_master_write_byte(cmd, OLED_CONTROL_BYTE_CMD_STREAM, true);
-
-	if (scroll == SCROLL_RIGHT) {
-		i2c_master_write_byte(cmd, OLED_CMD_HORIZONTAL_RIGHT, true);	// 26
-		i2c_master_write_byte(cmd, 0x00, true); // Dummy byte
-		i2c_master_write_byte(cmd, 0x00, true); // Define start page address
-		i2c_master_write_byte(cmd, 0x07, true); // Frame frequency
-		i2c_master_write_byte(cmd, 0x07, true); // Define end page address
-		i2c_master_write_byte(cmd, 0x00, true); //
-		i2c_master_write_byte(cmd, 0xFF, true); //
-		i2c_master_write_byte(cmd, OLED_CMD_ACTIVE_SCROLL, true);		// 2F
-	} 
-
-	if (scroll == SCROLL_LEFT) {
-		i2c_master_write_byte(cmd, OLED_CMD_HORIZONTAL_LEFT, true);		// 27
-		i2c_master_write_byte(cmd, 0x00, true); // Dummy byte
-		i2c_master_write_byte(cmd, 0x00, true); // Define start page address
-		i2c_master_write_byte(cmd, 0x07, true); // Frame frequency
-		i2c_master_write_byte(cmd, 0x07, true); // Define end page address
-		i2c_master_write_byte(cmd, 0x00, true); //
-		i2c_master_write_byte(cmd, 0xFF, true); //
-		i2c_master_write_byte(cmd, OLED_CMD_ACTIVE_SCROLL, true);		// 2F
-	} 
-
-	if (scroll == SCROLL_DOWN) {
-		i2c_master_write_byte(cmd, OLED_CMD_CONTINUOUS_SCROLL, true);	// 29
-		i2c_master_write_byte(cmd, 0x00, true); // Dummy byte
-		i2c_master_write_byte(cmd, 0x00, true); // Define start page address
-		i2c_master_write_byte(cmd, 0x07, true); // Frame frequency
-		//i2c_master_write_byte(cmd, 0x01, true); // Define end page address
-		i2c_master_write_byte(cmd, 0x00, true); // Define end page address
-		i2c_master_write_byte(cmd, 0x3F, true); // Vertical scrolling offset
-
-		i2c_master_write_byte(cmd, OLED_CMD_VERTICAL, true);			// A3
-		i2c_master_write_byte(cmd, 0x00, true);
-		if (dev->_height == 64)
-		//i2c_master_write_byte(cmd, 0x7F, true);
-		i2c_master_write_byte(cmd, 0x40, true);
-		if (dev->_height == 32)
-		i2c_master_write_byte(cmd, 0x20, true);
-		i2c_master_write_byte(cmd, OLED_CMD_ACTIVE_SCROLL, true);		// 2F
-	}
-
-	if (scroll == SCROLL_UP) {
-		i2c_master_write_byte(cmd, OLED_CMD_CONTINUOUS_SCROLL, true);	// 29
-		i2c_master_write_byte(cmd, 0x00, true); // Dummy byte
-		i2c_master_write_byte(cmd, 0x00, true); // Define start page address
-		i2c_master_write_byte(cmd, 0x07, true); // Frame frequency
-		//i2c_master_write_byte(cmd, 0x01, true); // Define end page address
-		i2c_master_write_byte(cmd, 0x00, true); // Define end page address
-		i2c_master_write_byte(cmd, 0x01, true); // Vertical scrolling offset
-
-		i2c_master_write_byte(cmd, OLED_CMD_VERTICAL, true);			// A3
-		i2c_master_write_byte(cmd, 0x00, true);
-		if (dev->_height == 64)
-		//i2c_master_write_byte(cmd, 0x7F, true);
-		i2c_master_write_byte(cmd, 0x40, true);
-		if (dev->_height == 32)
-		i2c_master_write_byte(cmd, 0x20, true);
-		i2c_master_write_byte(cmd, OLED_CMD_ACTIVE_SCROLL, true);		// 2F
+// Positioning and data in one transaction: every command byte gets its own
+// Co=1 control byte (0x80), then a single 0x40 switches to the data stream.
+// The control and command bytes are gathered first so they take a single write of the link.
+// Rows which are not contiguous take a write each, more than SSD1306_I2C_LINK_ROWS of them
+// go on in further transactions, the address pointer carries on where the last one stopped.
+static void i2c_write_window(SSD1306_t * dev, const uint8_t * cmds, int len, const uint8_t * data, int stride, int rows, int width) {
+	uint8_t header[2 * I2C_WINDOW_CMDS + 1];
+	assert(len <= I2C_WINDOW_CMDS);
+	for (int i=0; i<len; i++) {
+		header[2 * i] = OLED_CONTROL_BYTE_CMD_SINGLE;
+		header[2 * i + 1] = cmds[i];
 	}
-
-	if (scroll == SCROLL_STOP) {
-		i2c_master_write_byte(cmd, OLED_CMD_DEACTIVE_SCROLL, true);		// 2E
+	header[2 * len] = OLED_CONTROL_BYTE_DATA_STREAM;
+
+	i2c_cmd_handle_t cmd = i2c_link_begin(dev);
+	i2c_master_write(cmd, header, 2 * len + 1, true);
+	if (stride == width) {
+		i2c_master_write(cmd, data, rows * width, true);
+		i2c_link_end(dev, cmd, 2 * len + rows * width, "Image");
+		return;
 	}
-
-	i2c_master_stop(cmd);
-	espRc = i2c_master_cmd_begin(I2C_NUM, cmd, 10/portTICK_PERIOD_MS);
-	if (espRc == ESP_OK) {
-		ESP_LOGD(tag, "Scroll command succeeded");
-	} else {
-		ESP_LOGE(tag, "Scroll command failed. code: 0x%.2X", espRc);
+	for (int first=0; first<rows; first+=SSD1306_I2C_LINK_ROWS) {
+		int last = first + SSD1306_I2C_LINK_ROWS;
+		if (last > rows) last = rows;
+		if (first > 0) {
+			cmd = i2c_link_begin(dev);
+			i2c_master_write_byte(cmd, OLED_CONTROL_BYTE_DATA_STREAM, true);
+		}
+		for (int row=first; row<last; row++) {
+			i2c_master_write(cmd, data + row * stride, width, true);
+		}
+		int sent = (first > 0 ? 1 : 2 * len) + (last - first) * width;
+		if (i2c_link_end(dev, cmd, sent, "Image") != ESP_OK) return;
 	}
-
-	i2c_cmd_link_delete(cmd);
 }
-
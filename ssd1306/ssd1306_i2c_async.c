@@ -0,0 +1,302 @@
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "driver/i2c_master.h"
+#include "driver/gpio.h"
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+#include "ssd1306.h"
+
+#define tag "SSD1306"
+
+// Asynchronous I2C transport on the i2c_master driver of ESP-IDF 5.3 and later, built
+// instead of ssd1306_i2c.c when CONFIG_SSD1306_I2C_ASYNC is set. The two drivers cannot
+// be used in one firmware. Transfers are queued and the caller goes on at once, the
+// control bytes of each one wait in a slot of _i2cSlot until the driver reports it done.
+// As on SPI, data handed to flush_async must stay untouched until ssd1306_wait().
+
+// Port used by i2c_master_init(), other ports go through i2c_master_init_bus()
+#define I2C_NUM I2C_NUM_0
+//#define I2C_NUM I2C_NUM_1
+
+#ifdef CONFIG_SSD1306_I2C_CLOCK
+#define I2C_MASTER_FREQ_HZ CONFIG_SSD1306_I2C_CLOCK
+#else
+#define I2C_MASTER_FREQ_HZ 400000
+#endif
+
+// Milliseconds a transaction carrying len bytes may take, a full frame takes longer than the usual 10ms
+#define I2C_TIMEOUT_MS(dev, len) (10 + ((len) * 9 * 1000) / (dev)->_clockHz)
+
+static i2c_master_bus_handle_t i2c_bus[I2C_NUM_MAX];
+
+static void i2c_init(SSD1306_t * dev);
+static void i2c_write_cmds(SSD1306_t * dev, const uint8_t * cmds, int len);
+static void i2c_write_data(SSD1306_t * dev, const uint8_t * data, int len);
+static void i2c_write_window(SSD1306_t * dev, const uint8_t * cmds, int len, const uint8_t * data, int stride, int rows, int width);
+static void i2c_flush_async(SSD1306_t * dev, const uint8_t * cmds, int len, const uint8_t * data, int stride, int rows, int width);
+static void i2c_wait(SSD1306_t * dev);
+static esp_err_t i2c_set_clock(SSD1306_t * dev, int hz);
+static esp_err_t i2c_add_device(SSD1306_t * dev, int hz);
+
+static const ssd1306_bus_ops_t i2c_bus_ops = {
+	.init = i2c_init,
+	.write_cmds = i2c_write_cmds,
+	.write_data = i2c_write_data,
+	.write_window = i2c_write_window,
+	.flush_async = i2c_flush_async,
+	.wait = i2c_wait,
+	.set_clock = i2c_set_clock,
+};
+
+// One panel at I2CAddress on I2C_NUM
+void i2c_master_init(SSD1306_t * dev, int16_t sda, int16_t scl, int16_t reset)
+{
+	ESP_ERROR_CHECK(i2c_master_init_bus(I2C_NUM, sda, scl));
+	i2c_master_init_device(dev, I2C_NUM, I2CAddress, reset);
+}
+
+// Create the bus of port once, every panel on it is then added with i2c_master_init_device().
+// The driver queue has room for the slots of SSD1306_SCHEDULER_SIZE panels.
+esp_err_t i2c_master_init_bus(int port, int16_t sda, int16_t scl)
+{
+	if (port < 0 || port >= I2C_NUM_MAX) return ESP_ERR_INVALID_ARG;
+	i2c_master_bus_config_t bus_config = {
+		.i2c_port = port,
+		.sda_io_num = sda,
+		.scl_io_num = scl,
+		.clk_source = I2C_CLK_SRC_DEFAULT,
+		.glitch_ignore_cnt = 7,
+		.trans_queue_depth = SSD1306_I2C_QUEUE_SIZE * SSD1306_SCHEDULER_SIZE,
+		.flags.enable_internal_pullup = true,
+	};
+	return i2c_new_master_bus(&bus_config, &i2c_bus[port]);
+}
+
+// Panel at address (0x3C or 0x3D) on a port set up by i2c_master_init_bus().
+// reset < 0 when the panel has no reset line or shares one that was already pulsed.
+void i2c_master_init_device(SSD1306_t * dev, int port, int address, int16_t reset)
+{
+	if (reset >= 0) {
+		gpio_reset_pin(reset);
+		gpio_set_direction(reset, GPIO_MODE_OUTPUT);
+		gpio_set_level(reset, 0);
+		vTaskDelay(50 / portTICK_PERIOD_MS);
+		gpio_set_level(reset, 1);
+	}
+	// Set up before: the old device leaves the bus, it is added again below
+	if (ssd1306_release(dev) && dev->_ops == &i2c_bus_ops) {
+		i2c_wait(dev);
+		i2c_master_bus_rm_device(dev->_i2cDev);
+	}
+	dev->_address = address;
+	dev->_i2cPort = port;
+	dev->_flip = false;
+	dev->_flushTask = NULL;
+	dev->_sched = NULL;
+	dev->_transferDone = NULL;
+	dev->_fadeTimer = NULL;
+	dev->_fadeType = FADE_NONE;
+	dev->_canvas = NULL;
+	dev->_fb = NULL;
+	dev->_fbOwned = false;
+	dev->_fbCaps = MALLOC_CAP_8BIT;
+	dev->_initKey = SSD1306_INIT_KEY(dev);
+	dev->_ops = &i2c_bus_ops;
+	dev->_busCtx = NULL;
+	dev->_busErrors = 0;
+	dev->_i2cFree = xSemaphoreCreateCountingStatic(SSD1306_I2C_QUEUE_SIZE, SSD1306_I2C_QUEUE_SIZE, &dev->_i2cFreeBuffer);
+	dev->_i2cNext = 0;
+	ESP_ERROR_CHECK(i2c_add_device(dev, I2C_MASTER_FREQ_HZ));
+}
+
+// Runs in the driver's interrupt once a transaction left the bus. Transactions of
+// one device finish in the order they were queued, so this frees the oldest slot.
+static bool IRAM_ATTR i2c_done(i2c_master_dev_handle_t handle, const i2c_master_event_data_t * evt, void * arg)
+{
+	SSD1306_t * dev = arg;
+	esp_err_t result = ESP_OK;
+	if (evt->event == I2C_EVENT_ALIVE) return false;
+	if (evt->event == I2C_EVENT_TIMEOUT) {
+		result = ESP_ERR_TIMEOUT;
+	} else if (evt->event != I2C_EVENT_DONE) {
+		result = ESP_FAIL;
+	}
+	if (result != ESP_OK) dev->_busErrors++;
+	if (dev->_transferDone) dev->_transferDone(dev, result, dev->_transferArg);
+
+	BaseType_t woken = pdFALSE;
+	xSemaphoreGiveFromISR(dev->_i2cFree, &woken);
+	return woken == pdTRUE;
+}
+
+static esp_err_t i2c_add_device(SSD1306_t * dev, int hz)
+{
+	i2c_device_config_t dev_config = {
+		.dev_addr_length = I2C_ADDR_BIT_LEN_7,
+		.device_address = dev->_address,
+		.scl_speed_hz = hz,
+	};
+	esp_err_t ret = i2c_master_bus_add_device(i2c_bus[dev->_i2cPort], &dev_config, &dev->_i2cDev);
+	if (ret != ESP_OK) return ret;
+	i2c_master_event_callbacks_t callbacks = {
+		.on_trans_done = i2c_done,
+	};
+	ret = i2c_master_register_event_callbacks(dev->_i2cDev, &callbacks, dev);
+	if (ret != ESP_OK) {
+		i2c_master_bus_rm_device(dev->_i2cDev);
+		return ret;
+	}
+	dev->_clockHz = hz;
+	return ESP_OK;
+}
+
+// The clock is fixed when a device is added, so the device is added again.
+// Other panels on the port keep their clock.
+static esp_err_t i2c_set_clock(SSD1306_t * dev, int hz)
+{
+	i2c_wait(dev);
+	esp_err_t ret = i2c_master_bus_rm_device(dev->_i2cDev);
+	if (ret != ESP_OK) return ret;
+	ret = i2c_add_device(dev, hz);
+	if (ret != ESP_OK) {
+		ESP_LOGE(tag, "i2c_master_bus_add_device=%d at %dHz", ret, hz);
+		// Back to the clock that worked
+		i2c_add_device(dev, dev->_clockHz);
+	}
+	return ret;
+}
+
+// Next free slot, blocks while all of them are in flight
+static uint8_t * i2c_slot(SSD1306_t * dev)
+{
+	xSemaphoreTake(dev->_i2cFree, portMAX_DELAY);
+	return dev->_i2cSlot[dev->_i2cNext];
+}
+
+// Queue the first used bytes of the slot from i2c_slot(), followed by len bytes of data.
+// An error means nothing was queued and the slot is free again.
+static esp_err_t i2c_queue(SSD1306_t * dev, int used, const uint8_t * data, int len)
+{
+	uint8_t * slot = dev->_i2cSlot[dev->_i2cNext];
+	esp_err_t ret;
+	if (len == 0) {
+		ret = i2c_master_transmit(dev->_i2cDev, slot, used, I2C_TIMEOUT_MS(dev, used));
+	} else {
+		i2c_master_transmit_multi_buffer_info_t buffers[2] = {
+			{ .write_buffer = slot, .buffer_size = used },
+			{ .write_buffer = (uint8_t *)data, .buffer_size = len },
+		};
+		ret = i2c_master_multi_buffer_transmit(dev->_i2cDev, buffers, 2, I2C_TIMEOUT_MS(dev, used + len));
+	}
+	if (ret != ESP_OK) {
+		// Never queued, the slot is used again by the next transaction
+		ESP_LOGE(tag, "I2C transmit failed. code: 0x%.2X", ret);
+		dev->_busErrors++;
+		if (dev->_transferDone) dev->_transferDone(dev, ret, dev->_transferArg);
+		xSemaphoreGive(dev->_i2cFree);
+		return ret;
+	}
+	dev->_i2cNext = (dev->_i2cNext + 1) % SSD1306_I2C_QUEUE_SIZE;
+	return ESP_OK;
+}
+
+// Wait until every queued transaction left the bus
+static void i2c_wait(SSD1306_t * dev)
+{
+	for (int i=0; i<SSD1306_I2C_QUEUE_SIZE; i++) {
+		xSemaphoreTake(dev->_i2cFree, portMAX_DELAY);
+	}
+	for (int i=0; i<SSD1306_I2C_QUEUE_SIZE; i++) {
+		xSemaphoreGive(dev->_i2cFree);
+	}
+}
+
+// Check that the panel acknowledges its address
+static void i2c_init(SSD1306_t * dev)
+{
+	i2c_wait(dev);
+	esp_err_t espRc = i2c_master_probe(i2c_bus[dev->_i2cPort], dev->_address, 10);
+	if (espRc == ESP_OK) {
+		ESP_LOGI(tag, "OLED found at 0x%.2X", dev->_address);
+	} else {
+		ESP_LOGE(tag, "OLED not found at 0x%.2X. code: 0x%.2X", dev->_address, espRc);
+	}
+}
+
+static void i2c_write_cmds(SSD1306_t * dev, const uint8_t * cmds, int len)
+{
+	while (len > 0) {
+		int chunk = len > SSD1306_I2C_SLOT_SIZE - 1 ? SSD1306_I2C_SLOT_SIZE - 1 : len;
+		uint8_t * slot = i2c_slot(dev);
+		slot[0] = OLED_CONTROL_BYTE_CMD_STREAM;
+		memcpy(&slot[1], cmds, chunk);
+		if (i2c_queue(dev, 1 + chunk, NULL, 0) != ESP_OK) return;
+		cmds += chunk;
+		len -= chunk;
+	}
+}
+
+// Short data is copied and stays queued, longer data is waited for
+static void i2c_write_data(SSD1306_t * dev, const uint8_t * data, int len)
+{
+	uint8_t * slot = i2c_slot(dev);
+	slot[0] = OLED_CONTROL_BYTE_DATA_STREAM;
+	if (len < SSD1306_I2C_SLOT_SIZE) {
+		memcpy(&slot[1], data, len);
+		i2c_queue(dev, 1 + len, NULL, 0);
+		return;
+	}
+	i2c_queue(dev, 1, data, len);
+	i2c_wait(dev);
+}
+
+// Every command byte gets its own Co=1 control byte (0x80), then a single 0x40
+// switches to the data stream. Returns the bytes used in slot.
+static int i2c_window_header(uint8_t * slot, const uint8_t * cmds, int len)
+{
+	for (int i=0; i<len; i++) {
+		slot[2 * i] = OLED_CONTROL_BYTE_CMD_SINGLE;
+		slot[2 * i + 1] = cmds[i];
+	}
+	slot[2 * len] = OLED_CONTROL_BYTE_DATA_STREAM;
+	return 2 * len + 1;
+}
+
+// Positioning and data in one transaction. Rows that are not contiguous follow in
+// transactions of their own, the controller carries on at the address it reached.
+// A failed transaction ends the window, the rows after it would land at a wrong address.
+static void i2c_flush_async(SSD1306_t * dev, const uint8_t * cmds, int len, const uint8_t * data, int stride, int rows, int width)
+{
+	uint8_t * slot = i2c_slot(dev);
+	int used = i2c_window_header(slot, cmds, len);
+	if (stride == width) {
+		i2c_queue(dev, used, data, rows * width);
+		return;
+	}
+	if (i2c_queue(dev, used, data, width) != ESP_OK) return;
+	for (int row=1; row<rows; row++) {
+		slot = i2c_slot(dev);
+		slot[0] = OLED_CONTROL_BYTE_DATA_STREAM;
+		if (i2c_queue(dev, 1, data + row * stride, width) != ESP_OK) return;
+	}
+}
+
+// Images fitting behind the positioning bytes are copied and stay queued, larger ones are waited for
+static void i2c_write_window(SSD1306_t * dev, const uint8_t * cmds, int len, const uint8_t * data, int stride, int rows, int width)
+{
+	if (rows == 1 && 2 * len + 1 + width <= SSD1306_I2C_SLOT_SIZE) {
+		uint8_t * slot = i2c_slot(dev);
+		int used = i2c_window_header(slot, cmds, len);
+		memcpy(&slot[used], data, width);
+		i2c_queue(dev, used + width, NULL, 0);
+		return;
+	}
+	i2c_flush_async(dev, cmds, len, data, stride, rows, width);
+	i2c_wait(dev);
+}
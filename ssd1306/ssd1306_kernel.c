@@ -0,0 +1,192 @@
+#include <string.h>
+
+#include "ssd1306.h"
+
+// Bulk operations on byte buffers: framebuffer rows, images and masks.
+// They work a native word at a time (32 bits on the ESP32 chips, 64 on the linux
+// target) between a byte wise head up to word alignment and a byte wise tail.
+// Two buffer operations only use words when both buffers share the alignment,
+// which holds for rows of the same framebuffer and for buffers from the heap.
+// Words are moved with memcpy, which keeps the uint8_t buffers free of aliasing
+// trouble and compiles to a single load or store on the aligned addresses used here.
+
+typedef uintptr_t kernel_word_t;
+
+#define KERNEL_WORD sizeof(kernel_word_t)
+
+// Byte repeated in every byte of a word
+static inline kernel_word_t kernel_splat(uint8_t value)
+{
+	return (kernel_word_t)-1 / 0xFF * value;
+}
+
+// Word at p, which is word aligned
+static inline kernel_word_t kernel_load(const uint8_t * p)
+{
+	kernel_word_t wk;
+	memcpy(&wk, __builtin_assume_aligned(p, KERNEL_WORD), KERNEL_WORD);
+	return wk;
+}
+
+static inline void kernel_store(uint8_t * p, kernel_word_t wk)
+{
+	memcpy(__builtin_assume_aligned(p, KERNEL_WORD), &wk, KERNEL_WORD);
+}
+
+static inline bool kernel_aligned(const void * p)
+{
+	return ((uintptr_t)p & (KERNEL_WORD - 1)) == 0;
+}
+
+// Bytes before p reaches word alignment, at most blen
+static inline size_t kernel_head(const void * p, size_t blen)
+{
+	size_t head = (KERNEL_WORD - ((uintptr_t)p & (KERNEL_WORD - 1))) & (KERNEL_WORD - 1);
+	return (head < blen) ? head : blen;
+}
+
+// Set the bits of mask in every byte of buf to those of value, the rest stays.
+// mask 0xFF is a plain fill.
+void ssd1306_fill(uint8_t *buf, size_t blen, uint8_t value, uint8_t mask)
+{
+	if (mask == 0xFF) {
+		memset(buf, value, blen);
+		return;
+	}
+	uint8_t _value = value & mask;
+	size_t i = 0;
+	for (size_t head=kernel_head(buf, blen); i<head; i++) {
+		buf[i] = (buf[i] & ~mask) | _value;
+	}
+	kernel_word_t wmask = kernel_splat(mask);
+	kernel_word_t wvalue = kernel_splat(_value);
+	for (; i+KERNEL_WORD<=blen; i+=KERNEL_WORD) {
+		kernel_store(&buf[i], (kernel_load(&buf[i]) & ~wmask) | wvalue);
+	}
+	for (; i<blen; i++) {
+		buf[i] = (buf[i] & ~mask) | _value;
+	}
+}
+
+// Invert the bits of mask in every byte of buf
+void ssd1306_invert_mask(uint8_t *buf, size_t blen, uint8_t mask)
+{
+	size_t i = 0;
+	for (size_t head=kernel_head(buf, blen); i<head; i++) {
+		buf[i] ^= mask;
+	}
+	kernel_word_t wmask = kernel_splat(mask);
+	for (; i+KERNEL_WORD<=blen; i+=KERNEL_WORD) {
+		kernel_store(&buf[i], kernel_load(&buf[i]) ^ wmask);
+	}
+	for (; i<blen; i++) {
+		buf[i] ^= mask;
+	}
+}
+
+void ssd1306_invert(uint8_t *buf, size_t blen)
+{
+	ssd1306_invert_mask(buf, blen, 0xFF);
+}
+
+// Mirror every byte of buf top to bottom.
+// Not needed for _flip, the controller turns the panel.
+void ssd1306_flip(uint8_t *buf, size_t blen)
+{
+	size_t i = 0;
+	// Head up to word alignment, then four bytes at a time
+	for (; i<blen && ((uintptr_t)&buf[i] & 3); i++) {
+		buf[i] = ssd1306_rotate_byte(buf[i]);
+	}
+	for (; i+4<=blen; i+=4) {
+		uint32_t wk;
+		memcpy(&wk, __builtin_assume_aligned(&buf[i], 4), 4);
+		wk = ((wk >> 1) & 0x55555555) | ((wk & 0x55555555) << 1);
+		wk = ((wk >> 2) & 0x33333333) | ((wk & 0x33333333) << 2);
+		wk = ((wk >> 4) & 0x0F0F0F0F) | ((wk & 0x0F0F0F0F) << 4);
+		memcpy(__builtin_assume_aligned(&buf[i], 4), &wk, 4);
+	}
+	for (; i<blen; i++) {
+		buf[i] = ssd1306_rotate_byte(buf[i]);
+	}
+}
+
+// dst ^= src
+void ssd1306_xor(uint8_t *dst, const uint8_t *src, size_t blen)
+{
+	size_t i = 0;
+	for (size_t head=kernel_head(dst, blen); i<head; i++) {
+		dst[i] ^= src[i];
+	}
+	if (kernel_aligned(&src[i])) {
+		for (; i+KERNEL_WORD<=blen; i+=KERNEL_WORD) {
+			kernel_store(&dst[i], kernel_load(&dst[i]) ^ kernel_load(&src[i]));
+		}
+	}
+	for (; i<blen; i++) {
+		dst[i] ^= src[i];
+	}
+}
+
+// dst |= src
+void ssd1306_or(uint8_t *dst, const uint8_t *src, size_t blen)
+{
+	size_t i = 0;
+	for (size_t head=kernel_head(dst, blen); i<head; i++) {
+		dst[i] |= src[i];
+	}
+	if (kernel_aligned(&src[i])) {
+		for (; i+KERNEL_WORD<=blen; i+=KERNEL_WORD) {
+			kernel_store(&dst[i], kernel_load(&dst[i]) | kernel_load(&src[i]));
+		}
+	}
+	for (; i<blen; i++) {
+		dst[i] |= src[i];
+	}
+}
+
+// Copy the bits of src which are set in mask, the others of dst stay
+void ssd1306_copy_masked(uint8_t *dst, const uint8_t *src, const uint8_t *mask, size_t blen)
+{
+	size_t i = 0;
+	for (size_t head=kernel_head(dst, blen); i<head; i++) {
+		dst[i] = (dst[i] & ~mask[i]) | (src[i] & mask[i]);
+	}
+	if (kernel_aligned(&src[i]) && kernel_aligned(&mask[i])) {
+		for (; i+KERNEL_WORD<=blen; i+=KERNEL_WORD) {
+			kernel_word_t wmask = kernel_load(&mask[i]);
+			kernel_store(&dst[i], (kernel_load(&dst[i]) & ~wmask) | (kernel_load(&src[i]) & wmask));
+		}
+	}
+	for (; i<blen; i++) {
+		dst[i] = (dst[i] & ~mask[i]) | (src[i] & mask[i]);
+	}
+}
+
+// First and last byte where a and b differ, false when they are equal.
+// Equal words are skipped from both ends, only the differing words are looked into.
+bool ssd1306_diff_span(const uint8_t *a, const uint8_t *b, size_t blen, int *first, int *last)
+{
+	size_t start = 0;
+	size_t head = kernel_head(a, blen);
+	while (start < head && a[start] == b[start]) start++;
+	if (start == head && kernel_aligned(&b[start])) {
+		while (start + KERNEL_WORD <= blen
+			&& kernel_load(&a[start]) == kernel_load(&b[start])) start += KERNEL_WORD;
+	}
+	while (start < blen && a[start] == b[start]) start++;
+	if (start == blen) return false;
+
+	size_t end = blen;
+	size_t tail = end - ((uintptr_t)&a[end] & (KERNEL_WORD - 1));
+	if (tail < start) tail = start;
+	while (end > tail && a[end - 1] == b[end - 1]) end--;
+	if (end == tail && kernel_aligned(&b[end])) {
+		while (end >= start + KERNEL_WORD
+			&& kernel_load(&a[end - KERNEL_WORD]) == kernel_load(&b[end - KERNEL_WORD])) end -= KERNEL_WORD;
+	}
+	while (a[end - 1] == b[end - 1]) end--;
+	*first = start;
+	*last = end - 1;
+	return true;
+}
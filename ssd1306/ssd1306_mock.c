@@ -0,0 +1,145 @@
+#include <string.h>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+#include "ssd1306.h"
+
+#define TAG "SSD1306"
+
+// Must match the SPI transport, commands are sent in chunks of this size
+#define MOCK_SPI_CHUNK SSD1306_SPI_SLOT_SIZE
+// CPU time the SPI driver spends per queued transaction, measured roughly on an ESP32 at 240MHz
+#define MOCK_SPI_TRANSACTION_US 12
+
+// In-memory transport. Nothing leaves the MCU, every transfer is counted
+// and handed to mock->onWrite, so the driver runs without a panel or on a host.
+
+static void mock_init(SSD1306_t * dev);
+static void mock_write_cmds(SSD1306_t * dev, const uint8_t * cmds, int len);
+static void mock_write_data(SSD1306_t * dev, const uint8_t * data, int len);
+static void mock_write_window(SSD1306_t * dev, const uint8_t * cmds, int len, const uint8_t * data, int stride, int rows, int width);
+static esp_err_t mock_set_clock(SSD1306_t * dev, int hz);
+
+static const ssd1306_bus_ops_t mock_bus_ops = {
+	.init = mock_init,
+	.write_cmds = mock_write_cmds,
+	.write_data = mock_write_data,
+	.write_window = mock_write_window,
+	.flush_async = mock_write_window,
+	.wait = NULL,
+	.set_clock = mock_set_clock,
+};
+
+void mock_master_init(SSD1306_t * dev, ssd1306_mock_t * mock)
+{
+	ssd1306_release(dev);
+	dev->_address = I2CAddress;
+	dev->_flip = false;
+	dev->_flushTask = NULL;
+	dev->_sched = NULL;
+	dev->_transferDone = NULL;
+	dev->_fadeTimer = NULL;
+	dev->_fadeType = FADE_NONE;
+	dev->_canvas = NULL;
+	dev->_fb = NULL;
+	dev->_fbOwned = false;
+	dev->_fbCaps = MALLOC_CAP_8BIT;
+	dev->_initKey = SSD1306_INIT_KEY(dev);
+	dev->_ops = &mock_bus_ops;
+	dev->_busCtx = mock;
+	dev->_clockHz = 400000;
+	dev->_busErrors = 0;
+	mock_reset(mock);
+}
+
+void mock_reset(ssd1306_mock_t * mock)
+{
+	mock->cmdTransactions = 0;
+	mock->cmdBytes = 0;
+	mock->dataTransactions = 0;
+	mock->dataBytes = 0;
+	mock->i2cTransactions = 0;
+	mock->i2cBytes = 0;
+	mock->spiTransactions = 0;
+	mock->spiBytes = 0;
+}
+
+// Modelled I2C wire time: 9 clocks per byte plus start and stop per transaction
+uint32_t mock_i2c_time_us(ssd1306_mock_t * mock, int hz)
+{
+	uint64_t clocks = (uint64_t)mock->i2cBytes * 9 + (uint64_t)mock->i2cTransactions * 2;
+	return (uint32_t)(clocks * 1000000 / hz);
+}
+
+// Modelled SPI time: 8 clocks per byte plus the driver overhead of each transaction
+uint32_t mock_spi_time_us(ssd1306_mock_t * mock, int hz)
+{
+	uint64_t clocks = (uint64_t)mock->spiBytes * 8;
+	return (uint32_t)(clocks * 1000000 / hz) + mock->spiTransactions * MOCK_SPI_TRANSACTION_US;
+}
+
+static void mock_init(SSD1306_t * dev)
+{
+	ESP_LOGD(TAG, "mock bus ready");
+}
+
+static esp_err_t mock_set_clock(SSD1306_t * dev, int hz)
+{
+	dev->_clockHz = hz;
+	return ESP_OK;
+}
+
+// Transfer too fast for the modelled wiring, still counted as sent
+static void mock_check_clock(SSD1306_t * dev, ssd1306_mock_t * mock)
+{
+	if (mock->maxClockHz > 0 && dev->_clockHz > mock->maxClockHz) dev->_busErrors++;
+}
+
+static void mock_write_cmds(SSD1306_t * dev, const uint8_t * cmds, int len)
+{
+	ssd1306_mock_t * mock = dev->_busCtx;
+	mock_check_clock(dev, mock);
+	mock->cmdTransactions++;
+	mock->cmdBytes += len;
+	mock->i2cTransactions++;
+	mock->i2cBytes += 2 + len;
+	mock->spiTransactions += (len + MOCK_SPI_CHUNK - 1) / MOCK_SPI_CHUNK;
+	mock->spiBytes += len;
+	if (mock->onWrite) mock->onWrite(mock->arg, false, cmds, len);
+}
+
+static void mock_write_data(SSD1306_t * dev, const uint8_t * data, int len)
+{
+	ssd1306_mock_t * mock = dev->_busCtx;
+	mock_check_clock(dev, mock);
+	mock->dataTransactions++;
+	mock->dataBytes += len;
+	mock->i2cTransactions++;
+	mock->i2cBytes += 2 + len;
+	mock->spiTransactions++;
+	mock->spiBytes += len;
+	if (mock->onWrite) mock->onWrite(mock->arg, true, data, len);
+}
+
+// Counted as one transaction like on I2C, where positioning and data share it.
+// Rows which are not contiguous are split the way the blocking I2C transport does,
+// the transactions after the first carry a control byte and SSD1306_I2C_LINK_ROWS rows.
+static void mock_write_window(SSD1306_t * dev, const uint8_t * cmds, int len, const uint8_t * data, int stride, int rows, int width)
+{
+	ssd1306_mock_t * mock = dev->_busCtx;
+	int links = (stride == width) ? 1 : (rows + SSD1306_I2C_LINK_ROWS - 1) / SSD1306_I2C_LINK_ROWS;
+	mock_check_clock(dev, mock);
+	mock->dataTransactions++;
+	mock->cmdBytes += len;
+	mock->dataBytes += rows * width;
+	mock->i2cTransactions += links;
+	mock->i2cBytes += 1 + 2 * len + 1 + rows * width + (links - 1) * 2;
+	mock->spiTransactions += (len + MOCK_SPI_CHUNK - 1) / MOCK_SPI_CHUNK + ((stride == width) ? 1 : rows);
+	mock->spiBytes += len + rows * width;
+	if (mock->onWrite == NULL) return;
+	mock->onWrite(mock->arg, false, cmds, len);
+	for (int row=0; row<rows; row++) {
+		mock->onWrite(mock->arg, true, data + row * stride, width);
+	}
+}
@@ -5,6 +5,8 @@
 
 #include "driver/spi_master.h"
 #include "driver/gpio.h"
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
 #include "esp_log.h"
 
 #include "ssd1306.h"
@@ -23,9 +25,71 @@
 
 static const int SPI_Command_Mode = 0;
 static const int SPI_Data_Mode = 1;
-static const int SPI_Frequency = 1000000; // 1MHz
+#ifdef CONFIG_SSD1306_SPI_CLOCK
+#define SPI_Frequency CONFIG_SSD1306_SPI_CLOCK
+#else
+#define SPI_Frequency 1000000 // 1MHz
+#endif
+
+static void spi_init(SSD1306_t * dev);
+static void spi_write_cmds(SSD1306_t * dev, const uint8_t * cmds, int len);
+static void spi_write_data(SSD1306_t * dev, const uint8_t * data, int len);
+static void spi_write_window(SSD1306_t * dev, const uint8_t * cmds, int len, const uint8_t * data, int stride, int rows, int width);
+static void spi_flush_async(SSD1306_t * dev, const uint8_t * cmds, int len, const uint8_t * data, int stride, int rows, int width);
+static void spi_wait(SSD1306_t * dev);
+static esp_err_t spi_set_clock(SSD1306_t * dev, int hz);
+static esp_err_t spi_add_device(SSD1306_t * dev, int hz);
+
+static const ssd1306_bus_ops_t spi_bus_ops = {
+	.init = spi_init,
+	.write_cmds = spi_write_cmds,
+	.write_data = spi_write_data,
+	.write_window = spi_write_window,
+	.flush_async = spi_flush_async,
+	.wait = spi_wait,
+	.set_clock = spi_set_clock,
+};
+
+// DC pin and level travel in spi_transaction_t.user, 0 means leave DC alone
+#define SPI_USER_DC(dc, level) ((void *)(intptr_t)((((dc) + 1) << 1) | (level)))
+
+// Runs right before a queued transaction is put on the bus
+static void IRAM_ATTR spi_pre_transfer_callback(spi_transaction_t *t)
+{
+	int user = (int)(intptr_t)t->user;
+	if (user == 0) return;
+	gpio_set_level((user >> 1) - 1, user & 1);
+}
 
+// One panel on LCD_HOST
 void spi_master_init(SSD1306_t * dev, int16_t GPIO_MOSI, int16_t GPIO_SCLK, int16_t GPIO_CS, int16_t GPIO_DC, int16_t GPIO_RESET)
+{
+	esp_err_t ret = spi_master_init_bus( LCD_HOST, GPIO_MOSI, GPIO_SCLK );
+	assert(ret==ESP_OK);
+	spi_master_init_device( dev, LCD_HOST, GPIO_CS, GPIO_DC, GPIO_RESET );
+}
+
+// Set up host once, every panel on it is then added with spi_master_init_device()
+esp_err_t spi_master_init_bus(int host, int16_t GPIO_MOSI, int16_t GPIO_SCLK)
+{
+	spi_bus_config_t spi_bus_config = {
+		.mosi_io_num = GPIO_MOSI,
+		.miso_io_num = -1,
+		.sclk_io_num = GPIO_SCLK,
+		.quadwp_io_num = -1,
+		.quadhd_io_num = -1,
+		.max_transfer_sz = 0,
+		.flags = 0
+	};
+
+	esp_err_t ret = spi_bus_initialize( host, &spi_bus_config, SPI_DMA_CH_AUTO );
+	ESP_LOGI(TAG, "spi_bus_initialize=%d",ret);
+	return ret;
+}
+
+// Panel with its own CS and DC lines on a host set up by spi_master_init_bus().
+// Panels may share DC, it is set before every transaction.
+void spi_master_init_device(SSD1306_t * dev, int host, int16_t GPIO_CS, int16_t GPIO_DC, int16_t GPIO_RESET)
 {
 	esp_err_t ret;
 
@@ -48,34 +112,111 @@ void spi_master_init(SSD1306_t * dev, int16_t GPIO_MOSI, int16_t GPIO_SCLK, int1
 		gpio_set_level( GPIO_RESET, 1 );
 	}
 
-	spi_bus_config_t spi_bus_config = {
-		.mosi_io_num = GPIO_MOSI,
-		.miso_io_num = -1,
-		.sclk_io_num = GPIO_SCLK,
-		.quadwp_io_num = -1,
-		.quadhd_io_num = -1,
-		.max_transfer_sz = 0,
-		.flags = 0
-	};
-
-	ret = spi_bus_initialize( LCD_HOST, &spi_bus_config, SPI_DMA_CH_AUTO );
-	ESP_LOGI(TAG, "spi_bus_initialize=%d",ret);
-	assert(ret==ESP_OK);
-
-	spi_device_interface_config_t devcfg;
-	memset( &devcfg, 0, sizeof( spi_device_interface_config_t ) );
-	devcfg.clock_speed_hz = SPI_Frequency;
-	devcfg.spics_io_num = GPIO_CS;
-	devcfg.queue_size = 1;
-
-	spi_device_handle_t handle;
-	ret = spi_bus_add_device( LCD_HOST, &devcfg, &handle);
+	// Set up before: the old device leaves the bus, it is added again below
+	if (ssd1306_release(dev) && dev->_ops == &spi_bus_ops) {
+		spi_wait(dev);
+		spi_bus_remove_device( dev->_SPIHandle );
+	}
+	dev->_spiHost = host;
+	dev->_spiCs = GPIO_CS;
+	ret = spi_add_device( dev, SPI_Frequency );
 	ESP_LOGI(TAG, "spi_bus_add_device=%d",ret);
 	assert(ret==ESP_OK);
 	dev->_dc = GPIO_DC;
-	dev->_SPIHandle = handle;
 	dev->_address = SPIAddress;
 	dev->_flip = false;
+	dev->_flushTask = NULL;
+	dev->_sched = NULL;
+	dev->_transferDone = NULL;
+	dev->_fadeTimer = NULL;
+	dev->_fadeType = FADE_NONE;
+	dev->_canvas = NULL;
+	dev->_fb = NULL;
+	dev->_fbOwned = false;
+	dev->_fbCaps = MALLOC_CAP_DMA;
+	dev->_initKey = SSD1306_INIT_KEY(dev);
+	dev->_ops = &spi_bus_ops;
+	dev->_busCtx = NULL;
+	dev->_spiNext = 0;
+	dev->_spiPending = 0;
+	dev->_busErrors = 0;
+}
+
+static esp_err_t spi_add_device(SSD1306_t * dev, int hz)
+{
+	spi_device_interface_config_t devcfg;
+	memset( &devcfg, 0, sizeof( spi_device_interface_config_t ) );
+	devcfg.clock_speed_hz = hz;
+	devcfg.spics_io_num = dev->_spiCs;
+	devcfg.queue_size = SSD1306_SPI_QUEUE_SIZE;
+	devcfg.pre_cb = spi_pre_transfer_callback;
+
+	esp_err_t ret = spi_bus_add_device( dev->_spiHost, &devcfg, &dev->_SPIHandle );
+	if (ret == ESP_OK) dev->_clockHz = hz;
+	return ret;
+}
+
+// The SPI driver fixes the clock when a device is added, so the device is added again.
+// Other panels on the host keep their clock.
+static esp_err_t spi_set_clock(SSD1306_t * dev, int hz)
+{
+	spi_wait(dev);
+	esp_err_t ret = spi_bus_remove_device( dev->_SPIHandle );
+	if (ret != ESP_OK) return ret;
+	dev->_spiNext = 0;
+	ret = spi_add_device( dev, hz );
+	if (ret != ESP_OK) {
+		ESP_LOGE(TAG, "spi_bus_add_device=%d at %dHz", ret, hz);
+		// Back to the clock that worked
+		spi_add_device( dev, dev->_clockHz );
+	}
+	return ret;
+}
+
+// Put one transaction into the device queue. Up to SSD1306_SPI_SLOT_SIZE bytes are copied
+// when copy is set, otherwise Data must stay untouched until spi_wait().
+static void spi_queue(SSD1306_t * dev, int level, const uint8_t * Data, size_t DataLength, bool copy)
+{
+	spi_transaction_t * trans;
+
+	if (DataLength == 0) return;
+	if (dev->_spiPending == SSD1306_SPI_QUEUE_SIZE) {
+		// Oldest slot is reused, wait for it to leave the bus
+		spi_device_get_trans_result(dev->_SPIHandle, &trans, portMAX_DELAY);
+		dev->_spiPending--;
+	}
+
+	int slot = dev->_spiNext;
+	trans = &dev->_spiTrans[slot];
+	memset(trans, 0, sizeof(spi_transaction_t));
+	trans->length = DataLength * 8;
+	trans->user = SPI_USER_DC(dev->_dc, level);
+	if (copy) {
+		assert(DataLength <= SSD1306_SPI_SLOT_SIZE);
+		memcpy(dev->_spiSlot[slot], Data, DataLength);
+		trans->tx_buffer = dev->_spiSlot[slot];
+	} else {
+		trans->tx_buffer = Data;
+	}
+	esp_err_t ret = spi_device_queue_trans(dev->_SPIHandle, trans, portMAX_DELAY);
+	if (ret != ESP_OK) {
+		ESP_LOGE(TAG, "spi_device_queue_trans=%d", ret);
+		dev->_busErrors++;
+		return;
+	}
+	dev->_spiNext = (slot + 1) % SSD1306_SPI_QUEUE_SIZE;
+	dev->_spiPending++;
+}
+
+// Wait until every queued transaction left the bus
+static void spi_wait(SSD1306_t * dev)
+{
+	spi_transaction_t * trans;
+
+	while (dev->_spiPending > 0) {
+		spi_device_get_trans_result(dev->_SPIHandle, &trans, portMAX_DELAY);
+		dev->_spiPending--;
+	}
 }
 
 
@@ -95,161 +236,68 @@ bool spi_master_write_byte(spi_device_handle_t SPIHandle, const uint8_t* Data, s
 
 bool spi_master_write_command(SSD1306_t * dev, uint8_t Command )
 {
-	static uint8_t CommandByte = 0;
-	CommandByte = Command;
-	gpio_set_level( dev->_dc, SPI_Command_Mode );
-	return spi_master_write_byte( dev->_SPIHandle, &CommandByte, 1 );
+	spi_queue( dev, SPI_Command_Mode, &Command, 1, true );
+	return true;
+}
+
+// Several command bytes in as few transactions as possible, does not wait
+bool spi_master_write_commands(SSD1306_t * dev, const uint8_t* Commands, size_t Length )
+{
+	while ( Length > 0 ) {
+		size_t chunk = Length > SSD1306_SPI_SLOT_SIZE ? SSD1306_SPI_SLOT_SIZE : Length;
+		spi_queue( dev, SPI_Command_Mode, Commands, chunk, true );
+		Commands += chunk;
+		Length -= chunk;
+	}
+	return true;
 }
 
 bool spi_master_write_data(SSD1306_t * dev, const uint8_t* Data, size_t DataLength )
 {
-	gpio_set_level( dev->_dc, SPI_Data_Mode );
-	return spi_master_write_byte( dev->_SPIHandle, Data, DataLength );
+	spi_queue( dev, SPI_Data_Mode, Data, DataLength, false );
+	spi_wait( dev );
+	return true;
 }
 
 
-void spi_init(SSD1306_t * dev, int width, int height)
+// Nothing may be left in the queue from before a re-init
+static void spi_init(SSD1306_t * dev)
 {
-	dev->_width = width;
-	dev->_height = height;
-	dev->_pages = 8;
-	if (dev->_height == 32) dev->_pages = 4;
+	spi_wait(dev);
+	dev->_spiNext = 0;
+}
 
-	spi_master_write_command(dev, OLED_CMD_DISPLAY_OFF);			// AE
-	spi_master_write_command(dev, OLED_CMD_SET_MUX_RATIO);			// A8
-	if (dev->_height == 64) spi_master_write_command(dev, 0x3F);
-	if (dev->_height == 32) spi_master_write_command(dev, 0x1F);
-	spi_master_write_command(dev, OLED_CMD_SET_DISPLAY_OFFSET);		// D3
-	spi_master_write_command(dev, 0x00);
-	spi_master_write_command(dev, OLED_CONTROL_BYTE_DATA_STREAM);	// 40
-	if (dev->_flip) {
-		spi_master_write_command(dev, OLED_CMD_SET_SEGMENT_REMAP_0);	// A0
-	} else {
-		spi_master_write_command(dev, OLED_CMD_SET_SEGMENT_REMAP_1);	// A1
-	}
-	//spi_master_write_command(dev, OLED_CMD_SET_SEGMENT_REMAP);		// A1
-	spi_master_write_command(dev, OLED_CMD_SET_COM_SCAN_MODE);		// C8
-	spi_master_write_command(dev, OLED_CMD_SET_DISPLAY_CLK_DIV);	// D5
-	spi_master_write_command(dev, 0x80);
-	spi_master_write_command(dev, OLED_CMD_SET_COM_PIN_MAP);		// DA
-	if (dev->_height == 64) spi_master_write_command(dev, 0x12);
-	if (dev->_height == 32) spi_master_write_command(dev, 0x02);
-	spi_master_write_command(dev, OLED_CMD_SET_CONTRAST);			// 81
-	spi_master_write_command(dev, 0xFF);
-	spi_master_write_command(dev, OLED_CMD_DISPLAY_RAM);			// A4
-	spi_master_write_command(dev, OLED_CMD_SET_VCOMH_DESELCT);		// DB
-	spi_master_write_command(dev, 0x40);
-	spi_master_write_command(dev, OLED_CMD_SET_MEMORY_ADDR_MODE);	// 20
-	//spi_master_write_command(dev, OLED_CMD_SET_HORI_ADDR_MODE);	// 00
-	spi_master_write_command(dev, OLED_CMD_SET_PAGE_ADDR_MODE);		// 02
-	// Set Lower Column Start Address for Page Addressing Mode
-	spi_master_write_command(dev, 0x00);
-	// Set Higher Column Start Address for Page Addressing Mode
-	spi_master_write_command(dev, 0x10);
-	spi_master_write_command(dev, OLED_CMD_SET_CHARGE_PUMP);		// 8D
-	spi_master_write_command(dev, 0x14);
-	spi_master_write_command(dev, OLED_CMD_DEACTIVE_SCROLL);		// 2E
-	spi_master_write_command(dev, OLED_CMD_DISPLAY_NORMAL);			// A6
-	spi_master_write_command(dev, OLED_CMD_DISPLAY_ON);				// AF
-}
-
-
-void spi_display_image(SSD1306_t * dev, int page, int seg, uint8_t * images, int width)
-{
-	if (page >= dev->_pages) return;
-	if (seg >= dev->_width) return;
-
-	int _seg = seg + CONFIG_OFFSETX;
-	uint8_t columLow = _seg & 0x0F;
-	uint8_t columHigh = (_seg >> 4) & 0x0F;
-
-	int _page = page;
-	if (dev->_flip) {
-		_page = (dev->_pages - page) - 1;
-	}
+static void spi_write_cmds(SSD1306_t * dev, const uint8_t * cmds, int len)
+{
+	spi_master_write_commands(dev, cmds, len);
+}
 
-	// Set Lower Column Start Address for Page Addressing Mode
-	spi_master_write_command(dev, (0x00 + columLow));
-	// Set Higher Column Start Address for Page Addressing Mode
-	spi_master_write_command(dev, (0x10 + columHigh));
-	// Set Page Start Address for Page Addressing Mode
-	spi_master_write_command(dev, 0xB0 | _page);
-
-	spi_master_write_data(dev, images, width);
-
-}
-
-void spi_contrast(SSD1306_t * dev, int contrast) {
-	int _contrast = contrast;
-	if (contrast < 0x0) _contrast = 0;
-	if (contrast > 0xFF) _contrast = 0xFF;
-
-	spi_master_write_command(dev, OLED_CMD_SET_CONTRAST);			// 81
-	spi_master_write_command(dev, _contrast);
-}
-
-void spi_hardware_scroll(SSD1306_t * dev, ssd1306_scroll_type_t scroll)
-{
-
-	if (scroll == SCROLL_RIGHT) {
-		spi_master_write_command(dev, OLED_CMD_HORIZONTAL_RIGHT);	// 26
-		spi_master_write_command(dev, 0x00); // Dummy byte
-		spi_master_write_command(dev, 0x00); // Define start page address
-		spi_master_write_command(dev, 0x07); // Frame frequency
-		spi_master_write_command(dev, 0x07); // Define end page address
-		spi_master_write_command(dev, 0x00); //
-		spi_master_write_command(dev, 0xFF); //
-		spi_master_write_command(dev, OLED_CMD_ACTIVE_SCROLL);		// 2F
-	} 
-
-	if (scroll == SCROLL_LEFT) {
-		spi_master_write_command(dev, OLED_CMD_HORIZONTAL_LEFT);	// 27
-		spi_master_write_command(dev, 0x00); // Dummy byte
-		spi_master_write_command(dev, 0x00); // Define start page address
-		spi_master_write_command(dev, 0x07); // Frame frequency
-		spi_master_write_command(dev, 0x07); // Define end page address
-		spi_master_write_command(dev, 0x00); //
-		spi_master_write_command(dev, 0xFF); //
-		spi_master_write_command(dev, OLED_CMD_ACTIVE_SCROLL);		// 2F
-	} 
-
-	if (scroll == SCROLL_DOWN) {
-		spi_master_write_command(dev, OLED_CMD_CONTINUOUS_SCROLL);	// 29
-		spi_master_write_command(dev, 0x00); // Dummy byte
-		spi_master_write_command(dev, 0x00); // Define start page address
-		spi_master_write_command(dev, 0x07); // Frame frequency
-		//spi_master_write_command(dev, 0x01); // Define end page address
-		spi_master_write_command(dev, 0x00); // Define end page address
-		spi_master_write_command(dev, 0x3F); // Vertical scrolling offset
-
-		spi_master_write_command(dev, OLED_CMD_VERTICAL);			// A3
-		spi_master_write_command(dev, 0x00);
-		if (dev->_height == 64)
-			spi_master_write_command(dev, 0x40);
-		if (dev->_height == 32)
-			spi_master_write_command(dev, 0x20);
-		spi_master_write_command(dev, OLED_CMD_ACTIVE_SCROLL);		// 2F
-	}
+static void spi_write_data(SSD1306_t * dev, const uint8_t * data, int len)
+{
+	spi_master_write_data(dev, data, len);
+}
 
-	if (scroll == SCROLL_UP) {
-		spi_master_write_command(dev, OLED_CMD_CONTINUOUS_SCROLL);	// 29
-		spi_master_write_command(dev, 0x00); // Dummy byte
-		spi_master_write_command(dev, 0x00); // Define start page address
-		spi_master_write_command(dev, 0x07); // Frame frequency
-		//spi_master_write_command(dev, 0x01); // Define end page address
-		spi_master_write_command(dev, 0x00); // Define end page address
-		spi_master_write_command(dev, 0x01); // Vertical scrolling offset
-
-		spi_master_write_command(dev, OLED_CMD_VERTICAL);			// A3
-		spi_master_write_command(dev, 0x00);
-		if (dev->_height == 64)
-			spi_master_write_command(dev, 0x40);
-		if (dev->_height == 32)
-			spi_master_write_command(dev, 0x20);
-		spi_master_write_command(dev, OLED_CMD_ACTIVE_SCROLL);		// 2F
+// Queue positioning commands and data rows without waiting. Contiguous rows go out as a single DMA transfer.
+static void spi_flush_async(SSD1306_t * dev, const uint8_t * cmds, int len, const uint8_t * data, int stride, int rows, int width)
+{
+	spi_master_write_commands(dev, cmds, len);
+	if (stride == width) {
+		spi_queue(dev, SPI_Data_Mode, data, rows * width, false);
+	} else {
+		for (int row=0; row<rows; row++) {
+			spi_queue(dev, SPI_Data_Mode, data + row * stride, width, false);
+		}
 	}
+}
 
-	if (scroll == SCROLL_STOP) {
-		spi_master_write_command(dev, OLED_CMD_DEACTIVE_SCROLL);	// 2E
+// Images up to SSD1306_SPI_SLOT_SIZE bytes are copied and stay queued, larger ones are waited for
+static void spi_write_window(SSD1306_t * dev, const uint8_t * cmds, int len, const uint8_t * data, int stride, int rows, int width)
+{
+	if (rows == 1 && width <= SSD1306_SPI_SLOT_SIZE) {
+		spi_master_write_commands(dev, cmds, len);
+		spi_queue(dev, SPI_Data_Mode, data, width, true);
+	} else {
+		spi_flush_async(dev, cmds, len, data, stride, rows, width);
+		spi_wait(dev);
 	}
 }
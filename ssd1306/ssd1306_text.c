@@ -0,0 +1,358 @@
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "ssd1306.h"
+#include "font8x8_basic.h"
+#include "font8x8_prop.h"
+
+#define TAG "SSD1306"
+
+// Text drawn at any pixel position into the internal buffer. Nothing is sent,
+// the changed area is marked dirty and goes out with the next ssd1306_flush()
+// or ssd1306_flush_rect(), so several lines cost one transfer.
+
+const ssd1306_font_t ssd1306_font_8x8 = {
+	.bitmap = &font8x8_basic_tr[0][0],
+	.offsets = NULL,
+	.widths = NULL,
+	.first = 0x00,
+	.last = 0x7F,
+	.width = 8,
+	.height = 8,
+	.spacing = 0,
+};
+
+const ssd1306_font_t ssd1306_font_8x8_prop = {
+	.bitmap = font8x8_prop_bitmap,
+	.offsets = font8x8_prop_offsets,
+	.widths = font8x8_prop_widths,
+	.first = 0x20,
+	.last = 0x7E,
+	.width = 3,
+	.height = 8,
+	.spacing = 1,
+};
+
+// Every bit of the index repeated 2 and 3 times, 4 times is 2 times twice
+static const uint16_t scale_x2[256] = {
+    0x0000, 0x0003, 0x000C, 0x000F, 0x0030, 0x0033, 0x003C, 0x003F,
+    0x00C0, 0x00C3, 0x00CC, 0x00CF, 0x00F0, 0x00F3, 0x00FC, 0x00FF,
+    0x0300, 0x0303, 0x030C, 0x030F, 0x0330, 0x0333, 0x033C, 0x033F,
+    0x03C0, 0x03C3, 0x03CC, 0x03CF, 0x03F0, 0x03F3, 0x03FC, 0x03FF,
+    0x0C00, 0x0C03, 0x0C0C, 0x0C0F, 0x0C30, 0x0C33, 0x0C3C, 0x0C3F,
+    0x0CC0, 0x0CC3, 0x0CCC, 0x0CCF, 0x0CF0, 0x0CF3, 0x0CFC, 0x0CFF,
+    0x0F00, 0x0F03, 0x0F0C, 0x0F0F, 0x0F30, 0x0F33, 0x0F3C, 0x0F3F,
+    0x0FC0, 0x0FC3, 0x0FCC, 0x0FCF, 0x0FF0, 0x0FF3, 0x0FFC, 0x0FFF,
+    0x3000, 0x3003, 0x300C, 0x300F, 0x3030, 0x3033, 0x303C, 0x303F,
+    0x30C0, 0x30C3, 0x30CC, 0x30CF, 0x30F0, 0x30F3, 0x30FC, 0x30FF,
+    0x3300, 0x3303, 0x330C, 0x330F, 0x3330, 0x3333, 0x333C, 0x333F,
+    0x33C0, 0x33C3, 0x33CC, 0x33CF, 0x33F0, 0x33F3, 0x33FC, 0x33FF,
+    0x3C00, 0x3C03, 0x3C0C, 0x3C0F, 0x3C30, 0x3C33, 0x3C3C, 0x3C3F,
+    0x3CC0, 0x3CC3, 0x3CCC, 0x3CCF, 0x3CF0, 0x3CF3, 0x3CFC, 0x3CFF,
+    0x3F00, 0x3F03, 0x3F0C, 0x3F0F, 0x3F30, 0x3F33, 0x3F3C, 0x3F3F,
+    0x3FC0, 0x3FC3, 0x3FCC, 0x3FCF, 0x3FF0, 0x3FF3, 0x3FFC, 0x3FFF,
+    0xC000, 0xC003, 0xC00C, 0xC00F, 0xC030, 0xC033, 0xC03C, 0xC03F,
+    0xC0C0, 0xC0C3, 0xC0CC, 0xC0CF, 0xC0F0, 0xC0F3, 0xC0FC, 0xC0FF,
+    0xC300, 0xC303, 0xC30C, 0xC30F, 0xC330, 0xC333, 0xC33C, 0xC33F,
+    0xC3C0, 0xC3C3, 0xC3CC, 0xC3CF, 0xC3F0, 0xC3F3, 0xC3FC, 0xC3FF,
+    0xCC00, 0xCC03, 0xCC0C, 0xCC0F, 0xCC30, 0xCC33, 0xCC3C, 0xCC3F,
+    0xCCC0, 0xCCC3, 0xCCCC, 0xCCCF, 0xCCF0, 0xCCF3, 0xCCFC, 0xCCFF,
+    0xCF00, 0xCF03, 0xCF0C, 0xCF0F, 0xCF30, 0xCF33, 0xCF3C, 0xCF3F,
+    0xCFC0, 0xCFC3, 0xCFCC, 0xCFCF, 0xCFF0, 0xCFF3, 0xCFFC, 0xCFFF,
+    0xF000, 0xF003, 0xF00C, 0xF00F, 0xF030, 0xF033, 0xF03C, 0xF03F,
+    0xF0C0, 0xF0C3, 0xF0CC, 0xF0CF, 0xF0F0, 0xF0F3, 0xF0FC, 0xF0FF,
+    0xF300, 0xF303, 0xF30C, 0xF30F, 0xF330, 0xF333, 0xF33C, 0xF33F,
+    0xF3C0, 0xF3C3, 0xF3CC, 0xF3CF, 0xF3F0, 0xF3F3, 0xF3FC, 0xF3FF,
+    0xFC00, 0xFC03, 0xFC0C, 0xFC0F, 0xFC30, 0xFC33, 0xFC3C, 0xFC3F,
+    0xFCC0, 0xFCC3, 0xFCCC, 0xFCCF, 0xFCF0, 0xFCF3, 0xFCFC, 0xFCFF,
+    0xFF00, 0xFF03, 0xFF0C, 0xFF0F, 0xFF30, 0xFF33, 0xFF3C, 0xFF3F,
+    0xFFC0, 0xFFC3, 0xFFCC, 0xFFCF, 0xFFF0, 0xFFF3, 0xFFFC, 0xFFFF,
+};
+
+static const uint32_t scale_x3[256] = {
+    0x000000, 0x000007, 0x000038, 0x00003F, 0x0001C0, 0x0001C7, 0x0001F8, 0x0001FF,
+    0x000E00, 0x000E07, 0x000E38, 0x000E3F, 0x000FC0, 0x000FC7, 0x000FF8, 0x000FFF,
+    0x007000, 0x007007, 0x007038, 0x00703F, 0x0071C0, 0x0071C7, 0x0071F8, 0x0071FF,
+    0x007E00, 0x007E07, 0x007E38, 0x007E3F, 0x007FC0, 0x007FC7, 0x007FF8, 0x007FFF,
+    0x038000, 0x038007, 0x038038, 0x03803F, 0x0381C0, 0x0381C7, 0x0381F8, 0x0381FF,
+    0x038E00, 0x038E07, 0x038E38, 0x038E3F, 0x038FC0, 0x038FC7, 0x038FF8, 0x038FFF,
+    0x03F000, 0x03F007, 0x03F038, 0x03F03F, 0x03F1C0, 0x03F1C7, 0x03F1F8, 0x03F1FF,
+    0x03FE00, 0x03FE07, 0x03FE38, 0x03FE3F, 0x03FFC0, 0x03FFC7, 0x03FFF8, 0x03FFFF,
+    0x1C0000, 0x1C0007, 0x1C0038, 0x1C003F, 0x1C01C0, 0x1C01C7, 0x1C01F8, 0x1C01FF,
+    0x1C0E00, 0x1C0E07, 0x1C0E38, 0x1C0E3F, 0x1C0FC0, 0x1C0FC7, 0x1C0FF8, 0x1C0FFF,
+    0x1C7000, 0x1C7007, 0x1C7038, 0x1C703F, 0x1C71C0, 0x1C71C7, 0x1C71F8, 0x1C71FF,
+    0x1C7E00, 0x1C7E07, 0x1C7E38, 0x1C7E3F, 0x1C7FC0, 0x1C7FC7, 0x1C7FF8, 0x1C7FFF,
+    0x1F8000, 0x1F8007, 0x1F8038, 0x1F803F, 0x1F81C0, 0x1F81C7, 0x1F81F8, 0x1F81FF,
+    0x1F8E00, 0x1F8E07, 0x1F8E38, 0x1F8E3F, 0x1F8FC0, 0x1F8FC7, 0x1F8FF8, 0x1F8FFF,
+    0x1FF000, 0x1FF007, 0x1FF038, 0x1FF03F, 0x1FF1C0, 0x1FF1C7, 0x1FF1F8, 0x1FF1FF,
+    0x1FFE00, 0x1FFE07, 0x1FFE38, 0x1FFE3F, 0x1FFFC0, 0x1FFFC7, 0x1FFFF8, 0x1FFFFF,
+    0xE00000, 0xE00007, 0xE00038, 0xE0003F, 0xE001C0, 0xE001C7, 0xE001F8, 0xE001FF,
+    0xE00E00, 0xE00E07, 0xE00E38, 0xE00E3F, 0xE00FC0, 0xE00FC7, 0xE00FF8, 0xE00FFF,
+    0xE07000, 0xE07007, 0xE07038, 0xE0703F, 0xE071C0, 0xE071C7, 0xE071F8, 0xE071FF,
+    0xE07E00, 0xE07E07, 0xE07E38, 0xE07E3F, 0xE07FC0, 0xE07FC7, 0xE07FF8, 0xE07FFF,
+    0xE38000, 0xE38007, 0xE38038, 0xE3803F, 0xE381C0, 0xE381C7, 0xE381F8, 0xE381FF,
+    0xE38E00, 0xE38E07, 0xE38E38, 0xE38E3F, 0xE38FC0, 0xE38FC7, 0xE38FF8, 0xE38FFF,
+    0xE3F000, 0xE3F007, 0xE3F038, 0xE3F03F, 0xE3F1C0, 0xE3F1C7, 0xE3F1F8, 0xE3F1FF,
+    0xE3FE00, 0xE3FE07, 0xE3FE38, 0xE3FE3F, 0xE3FFC0, 0xE3FFC7, 0xE3FFF8, 0xE3FFFF,
+    0xFC0000, 0xFC0007, 0xFC0038, 0xFC003F, 0xFC01C0, 0xFC01C7, 0xFC01F8, 0xFC01FF,
+    0xFC0E00, 0xFC0E07, 0xFC0E38, 0xFC0E3F, 0xFC0FC0, 0xFC0FC7, 0xFC0FF8, 0xFC0FFF,
+    0xFC7000, 0xFC7007, 0xFC7038, 0xFC703F, 0xFC71C0, 0xFC71C7, 0xFC71F8, 0xFC71FF,
+    0xFC7E00, 0xFC7E07, 0xFC7E38, 0xFC7E3F, 0xFC7FC0, 0xFC7FC7, 0xFC7FF8, 0xFC7FFF,
+    0xFF8000, 0xFF8007, 0xFF8038, 0xFF803F, 0xFF81C0, 0xFF81C7, 0xFF81F8, 0xFF81FF,
+    0xFF8E00, 0xFF8E07, 0xFF8E38, 0xFF8E3F, 0xFF8FC0, 0xFF8FC7, 0xFF8FF8, 0xFF8FFF,
+    0xFFF000, 0xFFF007, 0xFFF038, 0xFFF03F, 0xFFF1C0, 0xFFF1C7, 0xFFF1F8, 0xFFF1FF,
+    0xFFFE00, 0xFFFE07, 0xFFFE38, 0xFFFE3F, 0xFFFFC0, 0xFFFFC7, 0xFFFFF8, 0xFFFFFF,
+};
+
+typedef struct {
+	int x0, y0; // First pixel inside
+	int x1, y1; // First pixel outside
+} text_clip_t;
+
+// Combine one column of up to 32 rows into the buffer. val and mask hold the rows
+// shifted by y % 8, the low byte lands in page, the following bytes in the pages below.
+static inline void text_put_column(SSD1306_t * dev, int page, int seg, uint64_t val, uint64_t mask)
+{
+	for (; mask; page++, val >>= 8, mask >>= 8) {
+		if ((mask & 0xFF) == 0 || page < 0 || page >= dev->_pages) continue;
+		uint8_t * dst = ssd1306_fb_seg(dev, page, seg);
+		*dst = (*dst & ~mask) | (val & mask);
+	}
+}
+
+// Rows of a cell height pixels high at y which lie inside the clip
+static uint32_t text_row_mask(int y, int height, const text_clip_t * clip)
+{
+	uint64_t rows = (1ULL << height) - 1;
+	if (y < clip->y0) rows = (clip->y0 - y >= height) ? 0 : rows & (rows << (clip->y0 - y));
+	if (y + height > clip->y1) rows = (y + height - clip->y1 >= height) ? 0 : rows & (rows >> (y + height - clip->y1));
+	return rows;
+}
+
+// Fill the columns x..x+width-1 of an 8 pixel high cell at y
+static void text_fill_cell(SSD1306_t * dev, int x, int y, int width, uint8_t pattern, const text_clip_t * clip)
+{
+	uint8_t rows = text_row_mask(y, 8, clip);
+	if (rows == 0) return;
+	int shift = y & 7;
+	int page = y >> 3;
+	uint64_t mask = (uint64_t)rows << shift;
+	uint64_t val = (uint64_t)(pattern & rows) << shift;
+	for (int seg=x; seg<x + width; seg++) {
+		if (seg < clip->x0 || seg >= clip->x1) continue;
+		text_put_column(dev, page, seg, val, mask);
+	}
+}
+
+// 8 rows of a glyph column grown to 8 * scale rows
+static inline uint32_t text_scale_byte(uint8_t bits, int scale)
+{
+	uint16_t x2;
+	switch (scale) {
+	case 2:
+		return scale_x2[bits];
+	case 3:
+		return scale_x3[bits];
+	case 4:
+		x2 = scale_x2[bits];
+		return scale_x2[x2 & 0xFF] | ((uint32_t)scale_x2[x2 >> 8] << 16);
+	default:
+		return bits;
+	}
+}
+
+// Width of ch in columns without spacing, 0 when the font has no such glyph
+static int text_glyph_width(const ssd1306_font_t * font, char ch)
+{
+	uint8_t code = ch;
+	if (code < font->first || code > font->last) return 0;
+	if (font->widths) return font->widths[code - font->first];
+	return font->width;
+}
+
+// Draw ch at x, y and return its advance. A character missing from the font is left blank.
+static int text_glyph(SSD1306_t * dev, const ssd1306_font_t * font, int scale, int x, int y, char ch, bool invert, const text_clip_t * clip)
+{
+	uint8_t code = ch;
+	int width = text_glyph_width(font, ch);
+	const uint8_t * columns = NULL;
+	if (width == 0) {
+		width = font->width;
+	} else if (font->offsets) {
+		columns = &font->bitmap[font->offsets[code - font->first]];
+	} else {
+		columns = &font->bitmap[(code - font->first) * font->width * (font->height / 8)];
+	}
+	int advance = (width + font->spacing) * scale;
+	if (x >= clip->x1 || x + advance <= clip->x0) return advance;
+
+	// Glyphs go on one page of the font at a time, each 8 * scale rows high
+	for (int page=0; page<font->height / 8; page++) {
+		int _y = y + page * 8 * scale;
+		uint32_t rows = text_row_mask(_y, 8 * scale, clip);
+		if (rows == 0) continue;
+		int shift = _y & 7;
+		uint64_t mask = (uint64_t)rows << shift;
+		for (int col=0; col<width + font->spacing; col++) {
+			uint8_t bits = 0;
+			if (columns && col < width) bits = columns[page * width + col];
+			if (invert) bits = ~bits;
+			uint64_t val = (uint64_t)(text_scale_byte(bits, scale) & rows) << shift;
+			for (int i=0; i<scale; i++) {
+				int seg = x + col * scale + i;
+				if (seg < clip->x0 || seg >= clip->x1) continue;
+				text_put_column(dev, _y >> 3, seg, val, mask);
+			}
+		}
+	}
+	return advance;
+}
+
+// Clip to the panel and mark the result dirty, false when nothing is left
+static bool text_clip(SSD1306_t * dev, int x, int y, int width, int height, text_clip_t * clip)
+{
+	clip->x0 = x < 0 ? 0 : x;
+	clip->y0 = y < 0 ? 0 : y;
+	clip->x1 = x + width > dev->_width ? dev->_width : x + width;
+	clip->y1 = y + height > dev->_height ? dev->_height : y + height;
+	if (clip->x0 >= clip->x1 || clip->y0 >= clip->y1) return false;
+	for (int page=clip->y0 / 8; page<=(clip->y1 - 1) / 8; page++) {
+		ssd1306_mark_dirty(dev, page, clip->x0, clip->x1 - clip->x0);
+	}
+	return true;
+}
+
+// Font used by ssd1306_draw_text() and ssd1306_draw_text_box(), scale 1 to 4
+void ssd1306_set_font(SSD1306_t * dev, const ssd1306_font_t * font, int scale)
+{
+	if (scale < 1) scale = 1;
+	if (scale > 4) scale = 4;
+	dev->_font = font ? font : &ssd1306_font_8x8;
+	dev->_fontScale = scale;
+}
+
+int ssd1306_text_height(SSD1306_t * dev)
+{
+	return dev->_font->height * dev->_fontScale;
+}
+
+static int text_width(const ssd1306_font_t * font, int scale, const char * text, int text_len)
+{
+	int width = 0;
+	for (int i=0; i<text_len; i++) {
+		int glyph = text_glyph_width(font, text[i]);
+		width += (glyph ? glyph : font->width) + font->spacing;
+	}
+	return width * scale;
+}
+
+static int text_draw(SSD1306_t * dev, const ssd1306_font_t * font, int scale, int x, int y, const char * text, int text_len, bool invert)
+{
+	if (text_len <= 0) return x;
+	text_clip_t clip;
+	if (text_clip(dev, x, y, text_width(font, scale, text, text_len), font->height * scale, &clip)) {
+		for (int i=0; i<text_len; i++) {
+			x += text_glyph(dev, font, scale, x, y, text[i], invert, &clip);
+		}
+	}
+	return x;
+}
+
+// Width in pixels of text drawn with the current font
+int ssd1306_text_width(SSD1306_t * dev, const char * text, int text_len)
+{
+	return text_width(dev->_font, dev->_fontScale, text, text_len);
+}
+
+// Draw text with the current font, its top left corner at x, y. Glyphs are clipped
+// at the panel edges. Returns the x following the last glyph.
+int ssd1306_draw_text(SSD1306_t * dev, int x, int y, const char * text, int text_len, bool invert)
+{
+	return text_draw(dev, dev->_font, dev->_fontScale, x, y, text, text_len, invert);
+}
+
+// Length of the next line of a box width pixels wide. Breaks after the last
+// space that fits, inside a word only when it is longer than a line. *next is
+// where the following line starts.
+static int text_wrap(SSD1306_t * dev, const char * text, int len, int width, int * next)
+{
+	int end = 0, brk = -1, used = 0;
+	while (end < len && text[end] != '\n') {
+		if (text[end] == ' ') brk = end;
+		used += ssd1306_text_width(dev, &text[end], 1);
+		if (used > width && end > 0) break;
+		end++;
+	}
+	if (end < len && text[end] == '\n') {
+		*next = end + 1;
+		return end;
+	}
+	if (end == len) {
+		*next = len;
+		return len;
+	}
+	// Line full
+	if (text[end] == ' ') {
+		brk = end;
+	} else if (brk < 0) {
+		*next = end;
+		return end;
+	}
+	*next = brk + 1;
+	return brk;
+}
+
+// Clear the box, then draw text word wrapped and aligned into it.
+// '\n' starts a new line. Text which does not fit is clipped at the bottom of the box.
+// Returns the number of characters drawn, text + result is where the next box would continue.
+int ssd1306_draw_text_box(SSD1306_t * dev, int x, int y, int width, int height, const char * text, int text_len, ssd1306_text_align_t align, bool invert)
+{
+	text_clip_t clip;
+	if (!text_clip(dev, x, y, width, height, &clip)) return 0;
+
+	uint8_t background = invert ? 0xFF : 0x00;
+	for (int _y=y; _y<y + height; _y+=8) {
+		text_fill_cell(dev, x, _y, width, background, &clip);
+	}
+
+	int lineHeight = ssd1306_text_height(dev);
+	int pos = 0;
+	for (int _y=y; pos<text_len && _y<y + height; _y+=lineHeight) {
+		int next;
+		int line = text_wrap(dev, text + pos, text_len - pos, width, &next);
+		int lineWidth = ssd1306_text_width(dev, text + pos, line);
+		int _x = x;
+		if (align == TEXT_ALIGN_CENTER) _x += (width - lineWidth) / 2;
+		if (align == TEXT_ALIGN_RIGHT) _x += width - lineWidth;
+		for (int i=0; i<line; i++) {
+			_x += text_glyph(dev, dev->_font, dev->_fontScale, _x, _y, text[pos + i], invert, &clip);
+		}
+		ESP_LOGD(TAG, "text box line y=%d len=%d", _y, line);
+		pos += next;
+	}
+	return pos;
+}
+
+// The whole line goes out as one transfer
+void ssd1306_display_text(SSD1306_t * dev, int page, char * text, int text_len, bool invert)
+{
+	if (page >= dev->_pages) return;
+	int _text_len = text_len;
+	if (_text_len > 16) _text_len = 16;
+
+	int width = text_draw(dev, &ssd1306_font_8x8, 1, 0, page * 8, text, _text_len, invert);
+	ssd1306_flush_rect(dev, 0, page * 8, width, 8);
+}
+
+// Text 3 times as high and wide as display_text, at most 5 characters from the left edge.
+// Originally by Coert Vonk.
+void ssd1306_display_text_x3(SSD1306_t * dev, int page, char * text, int text_len, bool invert)
+{
+	if (page >= dev->_pages) return;
+	int _text_len = text_len;
+	if (_text_len > 5) _text_len = 5;
+
+	int width = text_draw(dev, &ssd1306_font_8x8, 3, 0, page * 8, text, _text_len, invert);
+	ssd1306_flush_rect(dev, 0, page * 8, width, 24);
+}
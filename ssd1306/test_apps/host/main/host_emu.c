@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ssd1306.h"
+#include "ssd1306_emu.h"
+#include "host_test.h"
+
+// Set SSD1306_UPDATE_SNAPSHOTS to write the snapshots instead of comparing with them,
+// after a change that is meant to alter what the panel shows.
+
+typedef struct {
+	const char * name;
+	void (*run)(SSD1306_t * dev);
+	const char * snapshot; // PBM in HOST_SNAPSHOT_DIR the glass must match, NULL for none
+} host_scene_t;
+
+static void scene_shapes(SSD1306_t * dev)
+{
+	ssd1306_display_text(dev, 0, "Hello World!!!!!", 16, false);
+	ssd1306_draw_text(dev, 5, 13, "Emulator", 8, true);
+	ssd1306_draw_circle(dev, 96, 40, 20, false);
+	ssd1306_fill_round_rect(dev, 4, 40, 48, 20, 4, false);
+	ssd1306_fill_triangle(dev, 96, 40, 120, 28, 100, 56, false);
+	ssd1306_flush(dev);
+}
+
+// The same scene flushed in vertical addressing from the column layout
+static void scene_shapes_columns(SSD1306_t * dev)
+{
+	ssd1306_set_layout(dev, LAYOUT_COLUMNS);
+	scene_shapes(dev);
+}
+
+static void scene_wrap_columns(SSD1306_t * dev)
+{
+	scene_shapes_columns(dev);
+	ssd1306_wrap_arround(dev, SCROLL_UP, 0, 127, -1);
+	ssd1306_flush(dev);
+}
+
+// Column layout flushes of a rectangle off the page grid and of a single column
+static void scene_flush_columns(SSD1306_t * dev)
+{
+	ssd1306_set_layout(dev, LAYOUT_COLUMNS);
+	ssd1306_fill_rect(dev, 3, 21, 120, 9, false);
+	ssd1306_flush(dev);
+	ssd1306_draw_vline(dev, 127, 5, 50, false);
+	ssd1306_flush_rect(dev, 127, 5, 1, 50);
+}
+
+static const host_scene_t scenes[] = {
+	{ "shapes",         scene_shapes,         "shapes.pbm" },
+	{ "shapes columns", scene_shapes_columns, "shapes.pbm" },
+	{ "wrap columns",   scene_wrap_columns,   NULL },
+	{ "flush columns",  scene_flush_columns,  NULL },
+};
+
+// Compare the glass with the stored snapshot, or store it
+static bool host_snapshot(ssd1306_emu_t * emu, const char * name)
+{
+	char path[256];
+	snprintf(path, sizeof(path), "%s/%s", HOST_SNAPSHOT_DIR, name);
+	if (getenv("SSD1306_UPDATE_SNAPSHOTS")) {
+		FILE * fp = fopen(path, "wb");
+		if (fp == NULL) return false;
+		int ret = ssd1306_emu_write_pbm(emu, fp);
+		fclose(fp);
+		return ret == 0;
+	}
+
+	char * glass = NULL;
+	size_t glassLen = 0;
+	FILE * mem = open_memstream(&glass, &glassLen);
+	if (mem == NULL) return false;
+	ssd1306_emu_write_pbm(emu, mem);
+	fclose(mem);
+
+	bool same = false;
+	FILE * fp = fopen(path, "rb");
+	if (fp) {
+		char * stored = malloc(glassLen + 1);
+		same = stored && fread(stored, 1, glassLen + 1, fp) == glassLen && memcmp(stored, glass, glassLen) == 0;
+		free(stored);
+		fclose(fp);
+	}
+	free(glass);
+	return same;
+}
+
+int host_emu_check(bool verbose)
+{
+	static SSD1306_t dev;
+	static ssd1306_emu_t emu;
+	static uint8_t glass[8 * 128];
+	static uint8_t buffer[8 * 128];
+	ssd1306_mock_t mock = {0};
+	int failed = 0;
+
+	for (int i=0; i<sizeof(scenes)/sizeof(scenes[0]); i++) {
+		const host_scene_t * scene = &scenes[i];
+
+		ssd1306_emu_reset(&emu);
+		mock_master_init(&dev, &mock);
+		ssd1306_emu_attach(&emu, &mock);
+		ssd1306_init(&dev, 128, 64);
+		ssd1306_flush(&dev);
+
+		scene->run(&dev);
+
+		// What the driver holds must be what the panel shows
+		ssd1306_emu_frame(&emu, glass);
+		ssd1306_get_buffer(&dev, buffer);
+		bool same = memcmp(glass, buffer, sizeof(glass)) == 0;
+		bool snapshot = scene->snapshot == NULL || host_snapshot(&emu, scene->snapshot);
+		bool ok = same && snapshot && emu.unknownCmds == 0;
+		if (!ok) failed++;
+		if (verbose || !ok) {
+			printf("emu %-18s %s%s%s\n", scene->name, ok ? "ok" : "FAILED",
+				same ? "" : ", glass differs from the framebuffer",
+				snapshot ? "" : ", glass differs from the snapshot");
+		}
+	}
+	ssd1306_release(&dev);
+	return failed;
+}
@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "ssd1306.h"
+#include "host_test.h"
+
+// A filled shape covers its outline and nothing beyond the outline's extent
+
+typedef struct {
+	const char * name;
+	void (*draw)(SSD1306_t * dev, int x, int y, int width, int height, int r, bool invert);
+	void (*fill)(SSD1306_t * dev, int x, int y, int width, int height, int r, bool invert);
+	int x, y, width, height, r;
+} host_shape_t;
+
+static void gfx_draw_circle(SSD1306_t * dev, int x, int y, int width, int height, int r, bool invert)
+{
+	ssd1306_draw_circle(dev, x, y, r, invert);
+}
+
+static void gfx_fill_circle(SSD1306_t * dev, int x, int y, int width, int height, int r, bool invert)
+{
+	ssd1306_fill_circle(dev, x, y, r, invert);
+}
+
+static const host_shape_t shapes[] = {
+	{ "round_rect 11x2 r5",   ssd1306_draw_round_rect, ssd1306_fill_round_rect, 10, 10, 11, 2,  5 },
+	{ "round_rect 2x9 r3",    ssd1306_draw_round_rect, ssd1306_fill_round_rect, 10, 10, 2,  9,  3 },
+	{ "round_rect 11x4 r2",   ssd1306_draw_round_rect, ssd1306_fill_round_rect, 10, 10, 11, 4,  2 },
+	{ "round_rect 11x5 r2",   ssd1306_draw_round_rect, ssd1306_fill_round_rect, 10, 10, 11, 5,  2 },
+	{ "round_rect 20x16 r8",  ssd1306_draw_round_rect, ssd1306_fill_round_rect, 3,  21, 20, 16, 8 },
+	{ "round_rect 48x20 r4",  ssd1306_draw_round_rect, ssd1306_fill_round_rect, 4,  40, 48, 20, 4 },
+	{ "round_rect 1x1 r1",    ssd1306_draw_round_rect, ssd1306_fill_round_rect, 0,  0,  1,  1,  1 },
+	{ "round_rect clipped",   ssd1306_draw_round_rect, ssd1306_fill_round_rect, -5, 58, 30, 10, 4 },
+	{ "circle r1",            gfx_draw_circle,         gfx_fill_circle,         60, 30, 0,  0,  1 },
+	{ "circle r20",           gfx_draw_circle,         gfx_fill_circle,         96, 32, 0,  0,  20 },
+};
+
+// Columns and rows of the set pixels, false when there is none
+static bool host_extent(const uint8_t * buffer, int * x0, int * y0, int * x1, int * y1)
+{
+	*x0 = *y0 = 0x7FFF;
+	*x1 = *y1 = -1;
+	for (int y=0; y<64; y++) {
+		for (int x=0; x<128; x++) {
+			if ((buffer[(y / 8) * 128 + x] >> (y % 8)) & 1) {
+				if (x < *x0) *x0 = x;
+				if (x > *x1) *x1 = x;
+				if (y < *y0) *y0 = y;
+				if (y > *y1) *y1 = y;
+			}
+		}
+	}
+	return *x1 >= 0;
+}
+
+int host_gfx_check(bool verbose)
+{
+	static SSD1306_t dev;
+	static uint8_t outline[8 * 128];
+	static uint8_t filled[8 * 128];
+	ssd1306_mock_t mock = {0};
+	int failed = 0;
+
+	mock_master_init(&dev, &mock);
+	ssd1306_init(&dev, 128, 64);
+	for (int i=0; i<sizeof(shapes)/sizeof(shapes[0]); i++) {
+		const host_shape_t * shape = &shapes[i];
+
+		ssd1306_clear_screen(&dev, false);
+		shape->draw(&dev, shape->x, shape->y, shape->width, shape->height, shape->r, false);
+		ssd1306_get_buffer(&dev, outline);
+		ssd1306_clear_screen(&dev, false);
+		shape->fill(&dev, shape->x, shape->y, shape->width, shape->height, shape->r, false);
+		ssd1306_get_buffer(&dev, filled);
+
+		bool covered = true;
+		for (int j=0; j<sizeof(outline); j++) {
+			if (outline[j] & ~filled[j]) covered = false;
+		}
+		int ox0, oy0, ox1, oy1, fx0, fy0, fx1, fy1;
+		host_extent(outline, &ox0, &oy0, &ox1, &oy1);
+		host_extent(filled, &fx0, &fy0, &fx1, &fy1);
+		bool extent = (ox0 == fx0 && oy0 == fy0 && ox1 == fx1 && oy1 == fy1);
+		bool ok = covered && extent;
+		if (!ok) failed++;
+		if (verbose || !ok) {
+			printf("gfx %-20s %s", shape->name, ok ? "ok" : "FAILED");
+			if (!ok) printf(", outline %d,%d..%d,%d filled %d,%d..%d,%d", ox0, oy0, ox1, oy1, fx0, fy0, fx1, fy1);
+			printf("\n");
+		}
+	}
+	ssd1306_release(&dev);
+	return failed;
+}
@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ssd1306.h"
+#include "host_test.h"
+
+// Word kernels of ssd1306_kernel.c against the byte loops they replace, on random
+// buffers at random offsets and lengths, then timed on a 128x64 framebuffer
+
+#define KERNEL_CASES 20000
+#define KERNEL_MAX_LEN 300
+#define KERNEL_SLACK 16
+#define KERNEL_BENCH_LEN (128 * 8)
+#define KERNEL_BENCH_RUNS 20000
+
+static void ref_fill(uint8_t *buf, size_t blen, uint8_t value, uint8_t mask)
+{
+	for (size_t i=0; i<blen; i++) buf[i] = (buf[i] & ~mask) | (value & mask);
+}
+
+static void ref_invert_mask(uint8_t *buf, size_t blen, uint8_t mask)
+{
+	for (size_t i=0; i<blen; i++) buf[i] ^= mask;
+}
+
+static void ref_flip(uint8_t *buf, size_t blen)
+{
+	for (size_t i=0; i<blen; i++) buf[i] = ssd1306_rotate_byte(buf[i]);
+}
+
+static void ref_xor(uint8_t *dst, const uint8_t *src, size_t blen)
+{
+	for (size_t i=0; i<blen; i++) dst[i] ^= src[i];
+}
+
+static void ref_or(uint8_t *dst, const uint8_t *src, size_t blen)
+{
+	for (size_t i=0; i<blen; i++) dst[i] |= src[i];
+}
+
+static void ref_copy_masked(uint8_t *dst, const uint8_t *src, const uint8_t *mask, size_t blen)
+{
+	for (size_t i=0; i<blen; i++) dst[i] = (dst[i] & ~mask[i]) | (src[i] & mask[i]);
+}
+
+static bool ref_diff_span(const uint8_t *a, const uint8_t *b, size_t blen, int *first, int *last)
+{
+	int _first = -1;
+	for (size_t i=0; i<blen; i++) {
+		if (a[i] == b[i]) continue;
+		if (_first < 0) _first = i;
+		*last = i;
+	}
+	*first = _first;
+	return _first >= 0;
+}
+
+static void kernel_random(uint8_t * buf, size_t len)
+{
+	for (size_t i=0; i<len; i++) buf[i] = rand();
+}
+
+static int64_t kernel_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Each case works on one of the kernels and its reference, returns false when they differ
+static bool kernel_case(int op, uint8_t * a, uint8_t * b, const uint8_t * src, const uint8_t * mask, size_t len)
+{
+	uint8_t value = rand();
+	uint8_t bits = rand();
+	int first = -1, last = -1, _first = -1, _last = -1;
+	switch (op) {
+	case 0:
+		ssd1306_fill(a, len, value, bits);
+		ref_fill(b, len, value, bits);
+		break;
+	case 1:
+		ssd1306_fill(a, len, value, 0xFF);
+		ref_fill(b, len, value, 0xFF);
+		break;
+	case 2:
+		ssd1306_invert_mask(a, len, bits);
+		ref_invert_mask(b, len, bits);
+		break;
+	case 3:
+		ssd1306_flip(a, len);
+		ref_flip(b, len);
+		break;
+	case 4:
+		ssd1306_xor(a, src, len);
+		ref_xor(b, src, len);
+		break;
+	case 5:
+		ssd1306_or(a, src, len);
+		ref_or(b, src, len);
+		break;
+	case 6:
+		ssd1306_copy_masked(a, src, mask, len);
+		ref_copy_masked(b, src, mask, len);
+		break;
+	default:
+		// a few differing bytes in an otherwise equal buffer, or none
+		memcpy(a, src, len);
+		for (int n=rand() % 3; n>0 && len>0; n--) a[rand() % len] ^= 1 << (rand() % 8);
+		bool diff = ssd1306_diff_span(a, src, len, &first, &last);
+		bool _diff = ref_diff_span(a, src, len, &_first, &_last);
+		return diff == _diff && (!diff || (first == _first && last == _last));
+	}
+	return memcmp(a, b, len) == 0;
+}
+
+static const char * kernel_names[] = {
+	"fill masked", "fill", "invert_mask", "flip", "xor", "or", "copy_masked", "diff_span"
+};
+
+#define KERNEL_OPS (sizeof(kernel_names)/sizeof(kernel_names[0]))
+
+static void kernel_bench(void)
+{
+	static uint8_t a[KERNEL_BENCH_LEN];
+	static uint8_t src[KERNEL_BENCH_LEN];
+	static uint8_t mask[KERNEL_BENCH_LEN];
+	int first, last;
+	kernel_random(src, sizeof(src));
+	kernel_random(mask, sizeof(mask));
+	printf("%-12s %10s %10s\n", "kernel", "word ns", "byte ns");
+	for (int op=0; op<KERNEL_OPS; op++) {
+		int64_t ns[2];
+		for (int ref=0; ref<2; ref++) {
+			int64_t start = kernel_now_ns();
+			for (int run=0; run<KERNEL_BENCH_RUNS; run++) {
+				switch (op) {
+				case 0: ref ? ref_fill(a, KERNEL_BENCH_LEN, 0x5A, 0x3C) : ssd1306_fill(a, KERNEL_BENCH_LEN, 0x5A, 0x3C); break;
+				case 1: ref ? ref_fill(a, KERNEL_BENCH_LEN, 0x5A, 0xFF) : ssd1306_fill(a, KERNEL_BENCH_LEN, 0x5A, 0xFF); break;
+				case 2: ref ? ref_invert_mask(a, KERNEL_BENCH_LEN, 0x3C) : ssd1306_invert_mask(a, KERNEL_BENCH_LEN, 0x3C); break;
+				case 3: ref ? ref_flip(a, KERNEL_BENCH_LEN) : ssd1306_flip(a, KERNEL_BENCH_LEN); break;
+				case 4: ref ? ref_xor(a, src, KERNEL_BENCH_LEN) : ssd1306_xor(a, src, KERNEL_BENCH_LEN); break;
+				case 5: ref ? ref_or(a, src, KERNEL_BENCH_LEN) : ssd1306_or(a, src, KERNEL_BENCH_LEN); break;
+				case 6: ref ? ref_copy_masked(a, src, mask, KERNEL_BENCH_LEN) : ssd1306_copy_masked(a, src, mask, KERNEL_BENCH_LEN); break;
+				default:
+					// Equal buffers, the whole length is compared
+					memcpy(a, src, KERNEL_BENCH_LEN);
+					ref ? ref_diff_span(a, src, KERNEL_BENCH_LEN, &first, &last) : ssd1306_diff_span(a, src, KERNEL_BENCH_LEN, &first, &last);
+					break;
+				}
+			}
+			ns[ref] = (kernel_now_ns() - start) / KERNEL_BENCH_RUNS;
+		}
+		printf("%-12s %10lld %10lld\n", kernel_names[op], (long long)ns[0], (long long)ns[1]);
+	}
+}
+
+int host_kernel_check(bool verbose)
+{
+	static uint8_t a[KERNEL_MAX_LEN + KERNEL_SLACK];
+	static uint8_t b[KERNEL_MAX_LEN + KERNEL_SLACK];
+	static uint8_t src[KERNEL_MAX_LEN + KERNEL_SLACK];
+	static uint8_t mask[KERNEL_MAX_LEN + KERNEL_SLACK];
+	int failed[KERNEL_OPS] = {0};
+	int total = 0;
+
+	srand(1306);
+	for (int i=0; i<KERNEL_CASES; i++) {
+		int op = i % KERNEL_OPS;
+		size_t len = rand() % (KERNEL_MAX_LEN + 1);
+		// Offsets independent of each other, so the aligned and unaligned paths both run
+		uint8_t * _a = &a[rand() % KERNEL_SLACK];
+		uint8_t * _b = &b[_a - a];
+		const uint8_t * _src = &src[rand() % KERNEL_SLACK];
+		const uint8_t * _mask = &mask[rand() % KERNEL_SLACK];
+		kernel_random(a, sizeof(a));
+		memcpy(b, a, sizeof(b));
+		kernel_random(src, sizeof(src));
+		kernel_random(mask, sizeof(mask));
+		if (!kernel_case(op, _a, _b, _src, _mask, len)) failed[op]++;
+		// Nothing outside the buffer is touched
+		if (memcmp(a, b, _a - a) || memcmp(_a + len, _b + len, sizeof(a) - (_a - a) - len)) failed[op]++;
+	}
+	for (int op=0; op<KERNEL_OPS; op++) {
+		total += failed[op];
+		if (verbose || failed[op]) {
+			printf("kernel %-12s %s\n", kernel_names[op], failed[op] ? "FAILED" : "ok");
+		}
+	}
+	if (verbose) kernel_bench();
+	return total;
+}
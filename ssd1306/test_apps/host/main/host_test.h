@@ -0,0 +1,18 @@
+#ifndef MAIN_HOST_TEST_H_
+#define MAIN_HOST_TEST_H_
+
+#include <stdbool.h>
+
+// Checks of the host test app, each returns the number of failed cases
+
+// Renders scenes through the mock transport into the controller emulator and
+// compares the glass with the framebuffer and with the snapshots in HOST_SNAPSHOT_DIR
+int host_emu_check(bool verbose);
+
+// Draws outlined and filled shapes and checks that each fill covers exactly its outline
+int host_gfx_check(bool verbose);
+
+// Compares the word kernels with byte loops on random buffers, times both when verbose
+int host_kernel_check(bool verbose);
+
+#endif /* MAIN_HOST_TEST_H_ */
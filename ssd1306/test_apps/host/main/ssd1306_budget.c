@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "ssd1306.h"
+#include "ssd1306_budget.h"
+
+// Budgets are what the calls cost when they were recorded. Raise one only
+// together with the change that makes the call more expensive, lower it
+// whenever a call gets cheaper so the gain cannot be lost again.
+
+static uint8_t budget_bitmap[4*32];
+
+static void budget_display_text(SSD1306_t * dev)
+{
+	ssd1306_display_text(dev, 2, "Hello World!!!!!", 16, false);
+}
+
+static void budget_display_text_x3(SSD1306_t * dev)
+{
+	ssd1306_display_text_x3(dev, 2, "Hello", 5, false);
+}
+
+static void budget_text_box(SSD1306_t * dev)
+{
+	char * status = "WiFi connected\nIP 192.168.1.20\nUptime 12:34:56";
+	ssd1306_draw_text_box(dev, 0, 8, 128, 24, status, strlen(status), TEXT_ALIGN_LEFT, false);
+	ssd1306_flush(dev);
+}
+
+static void budget_bitmaps(SSD1306_t * dev)
+{
+	memset(budget_bitmap, 0xA5, sizeof(budget_bitmap));
+	ssd1306_bitmaps(dev, 3, 5, budget_bitmap, 32, 32, false);
+}
+
+static void budget_blit(SSD1306_t * dev)
+{
+	// 16x16 sprite with mask, off the page grid
+	ssd1306_image_t sprite = {
+		.data = budget_bitmap,
+		.mask = &budget_bitmap[32],
+		.width = 16,
+		.height = 16,
+		.format = IMAGE_PAGE_MAJOR,
+	};
+	memset(budget_bitmap, 0x3C, sizeof(budget_bitmap));
+	ssd1306_blit(dev, 40, 13, &sprite, BLIT_XOR, false);
+	ssd1306_flush(dev);
+}
+
+static void budget_wrap_arround(SSD1306_t * dev)
+{
+	ssd1306_display_text(dev, 0, "Hello World!!!!!", 16, false);
+	ssd1306_flush(dev);
+	ssd1306_wrap_arround(dev, SCROLL_LEFT, 0, 7, 0);
+}
+
+static void budget_wrap_arround_buffered(SSD1306_t * dev)
+{
+	ssd1306_wrap_arround(dev, SCROLL_UP, 0, 127, -1);
+	ssd1306_flush(dev);
+}
+
+static void budget_wrap_arround_columns(SSD1306_t * dev)
+{
+	ssd1306_set_layout(dev, LAYOUT_COLUMNS);
+	ssd1306_wrap_arround(dev, SCROLL_UP, 0, 127, -1);
+	ssd1306_flush(dev);
+}
+
+// Column layout, 120 columns in vertical addressing through the I2C window limits of the mock
+static void budget_flush_columns(SSD1306_t * dev)
+{
+	ssd1306_set_layout(dev, LAYOUT_COLUMNS);
+	ssd1306_fill_rect(dev, 3, 21, 120, 9, false);
+	ssd1306_flush(dev);
+}
+
+// Pan of a 256x128 canvas, counted from the pan on
+static void budget_viewport(SSD1306_t * dev, int x, int y)
+{
+	ssd1306_set_virtual(dev, 256, 128);
+	ssd1306_draw_text(dev, 100, 60, "Hello World!!!!!", 16, false);
+	ssd1306_flush(dev);
+	mock_reset((ssd1306_mock_t *)dev->_busCtx);
+	ssd1306_set_viewport(dev, x, y);
+	ssd1306_set_virtual(dev, 0, 0);
+}
+
+static void budget_viewport_column(SSD1306_t * dev)
+{
+	dev->_hwContentScroll = true;
+	budget_viewport(dev, 1, 0);
+}
+
+static void budget_viewport_column_software(SSD1306_t * dev)
+{
+	dev->_hwContentScroll = false;
+	budget_viewport(dev, 1, 0);
+}
+
+static void budget_viewport_row(SSD1306_t * dev)
+{
+	budget_viewport(dev, 0, 1);
+}
+
+static void budget_vscroll(SSD1306_t * dev)
+{
+	ssd1306_vscroll(dev, 1);
+}
+
+static const uint8_t budget_column[2] = { 0x7E, 0x42 };
+
+// Panels with the content scroll, CONFIG_SSD1306_HW_CONTENT_SCROLL
+static void budget_ticker_step(SSD1306_t * dev)
+{
+	dev->_hwContentScroll = true;
+	ssd1306_ticker_step(dev, SCROLL_LEFT, 2, 3, 0, 127, budget_column);
+}
+
+// Every panel, the default
+static void budget_ticker_step_software(SSD1306_t * dev)
+{
+	dev->_hwContentScroll = false;
+	ssd1306_ticker_step(dev, SCROLL_LEFT, 2, 3, 0, 127, budget_column);
+}
+
+static void budget_scroll_text(SSD1306_t * dev)
+{
+	ssd1306_software_scroll(dev, 0, 7);
+	ssd1306_scroll_text(dev, "Hello", 5, false);
+}
+
+static void budget_fadeout(SSD1306_t * dev)
+{
+	ssd1306_fadeout(dev);
+}
+
+static void budget_clear_line(SSD1306_t * dev)
+{
+	ssd1306_clear_line(dev, 3, false);
+}
+
+static void budget_clear_screen(SSD1306_t * dev)
+{
+	ssd1306_clear_screen(dev, false);
+}
+
+static void budget_show_buffer(SSD1306_t * dev)
+{
+	ssd1306_show_buffer(dev);
+}
+
+static void budget_flush_line(SSD1306_t * dev)
+{
+	_ssd1306_line(dev, 0, 0, 127, 63, false);
+	ssd1306_flush(dev);
+}
+
+static void budget_gauge(SSD1306_t * dev)
+{
+	ssd1306_draw_circle(dev, 96, 32, 28, false);
+	ssd1306_fill_round_rect(dev, 4, 40, 48, 20, 4, false);
+	ssd1306_fill_triangle(dev, 96, 32, 120, 20, 100, 36, false);
+	ssd1306_flush(dev);
+}
+
+static void budget_contrast(SSD1306_t * dev)
+{
+	ssd1306_contrast(dev, 0x40);
+}
+
+static void budget_hardware_scroll(SSD1306_t * dev)
+{
+	ssd1306_hardware_scroll(dev, SCROLL_RIGHT);
+}
+
+static const ssd1306_budget_t budgets[] = {
+	// name                    run                             I2C tr  I2C bytes  SPI tr
+	{ "display_text",          budget_display_text,            1,      140,       2 },
+	{ "display_text_x3",       budget_display_text_x3,         1,      374,       4 },
+	{ "text_box + flush",      budget_text_box,                1,      398,       4 },
+	{ "bitmaps",               budget_bitmaps,                 1,      174,       6 },
+	{ "blit + flush",          budget_blit,                    1,      62,        4 },
+	{ "wrap_arround",          budget_wrap_arround,            9,      1228,      18 },
+	{ "wrap_arround buffered", budget_wrap_arround_buffered,   1,      1038,      9 },
+	{ "wrap_arround columns",  budget_wrap_arround_columns,    1,      1042,      2 },
+	{ "rect + flush columns",  budget_flush_columns,           1,      978,       2 },
+	{ "viewport column",       budget_viewport_column,         3,      38,        4 },
+	{ "viewport col software", budget_viewport_column_software, 9,     1091,      17 },
+	{ "viewport row",          budget_viewport_row,            3,      142,       4 },
+	{ "vscroll",               budget_vscroll,                 1,      3,         1 },
+	{ "ticker_step",           budget_ticker_step,             2,      25,        4 },
+	{ "ticker_step software",  budget_ticker_step_software,    1,      270,       2 },
+	{ "scroll_text",           budget_scroll_text,             8,      1004,      16 },
+	{ "fadeout",               budget_fadeout,                 64,     8708,      128 },
+	{ "clear_line",            budget_clear_line,              1,      140,       2 },
+	{ "clear_screen",          budget_clear_screen,            1,      1038,      9 },
+	{ "show_buffer",           budget_show_buffer,             1,      1038,      9 },
+	{ "line + flush",          budget_flush_line,              8,      196,       16 },
+	{ "shapes + flush",        budget_gauge,                   8,      716,       16 },
+	{ "contrast",              budget_contrast,                1,      4,         1 },
+	{ "hardware_scroll",       budget_hardware_scroll,         1,      10,        1 },
+};
+
+int ssd1306_budget_check(bool verbose)
+{
+	static SSD1306_t dev;
+	ssd1306_mock_t mock = {0};
+	int failed = 0;
+
+	if (verbose) {
+		printf("%-22s %7s %7s %7s %7s | %9s %9s %9s | %9s %9s %9s\n",
+			"call", "i2c tr", "bytes", "spi tr", "bytes",
+			"100kHz us", "400kHz us", "1MHz us", "SPI1M us", "SPI8M us", "SPI10M us");
+	}
+	for (int i=0; i<sizeof(budgets)/sizeof(budgets[0]); i++) {
+		const ssd1306_budget_t * budget = &budgets[i];
+
+		// Every call starts from a blank, fully flushed panel.
+		// Setting dev up again frees the framebuffer of the call before.
+		mock_master_init(&dev, &mock);
+		ssd1306_init(&dev, 128, 64);
+		ssd1306_flush(&dev);
+		mock_reset(&mock);
+
+		budget->run(&dev);
+
+		bool over = mock.i2cTransactions > budget->i2cTransactions
+			|| mock.i2cBytes > budget->i2cBytes
+			|| mock.spiTransactions > budget->spiTransactions;
+		if (over) failed++;
+		if (verbose || over) {
+			printf("%-22s %7d %7d %7d %7d | %9"PRIu32" %9"PRIu32" %9"PRIu32" | %9"PRIu32" %9"PRIu32" %9"PRIu32"%s\n",
+				budget->name, mock.i2cTransactions, mock.i2cBytes, mock.spiTransactions, mock.spiBytes,
+				mock_i2c_time_us(&mock, 100000), mock_i2c_time_us(&mock, 400000), mock_i2c_time_us(&mock, 1000000),
+				mock_spi_time_us(&mock, 1000000), mock_spi_time_us(&mock, 8000000), mock_spi_time_us(&mock, 10000000),
+				over ? "  OVER BUDGET" : "");
+		}
+		if (over) {
+			printf("%-22s budget %d transactions, %d bytes on I2C, %d transactions on SPI\n",
+				"", budget->i2cTransactions, budget->i2cBytes, budget->spiTransactions);
+		}
+	}
+	ssd1306_release(&dev);
+	return failed;
+}
@@ -0,0 +1,23 @@
+#ifndef MAIN_SSD1306_BUDGET_H_
+#define MAIN_SSD1306_BUDGET_H_
+
+#include <stdbool.h>
+
+#include "ssd1306.h"
+
+// Bus traffic budget of the public API.
+// Every call is run against the mock transport on a 128x64 panel and the
+// traffic is compared with the budget recorded in ssd1306_budget.c.
+
+typedef struct {
+	const char * name;
+	void (*run)(SSD1306_t * dev);
+	int i2cTransactions;
+	int i2cBytes;
+	int spiTransactions;
+} ssd1306_budget_t;
+
+// Runs every call, prints the report when verbose and returns the number of calls over budget
+int ssd1306_budget_check(bool verbose);
+
+#endif /* MAIN_SSD1306_BUDGET_H_ */
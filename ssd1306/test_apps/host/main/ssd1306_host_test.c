@@ -0,0 +1,19 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ssd1306.h"
+#include "ssd1306_budget.h"
+#include "host_test.h"
+
+void app_main(void)
+{
+	int failed = ssd1306_budget_check(true);
+	printf("budget: %d over\n", failed);
+	int emu = host_emu_check(true);
+	printf("emulator: %d failed\n", emu);
+	int gfx = host_gfx_check(true);
+	printf("primitives: %d failed\n", gfx);
+	int kernel = host_kernel_check(true);
+	printf("kernels: %d failed\n", kernel);
+	exit((failed || emu || gfx || kernel) ? EXIT_FAILURE : EXIT_SUCCESS);
+}